@@ -25,6 +25,7 @@
 #include "files.hpp"
 #include "for.hpp"
 #include "grammar.hpp"
+#include "include_cache.hpp"
 #include "markups.hpp"
 #include "path.hpp"
 #include "phrase_tags.hpp"
@@ -366,6 +367,8 @@ namespace quickbook
 
     void paragraph_action::operator()() const
     {
+        ++state.paragraph_count;
+
         std::string str;
         state.phrase.swap(str);
 
@@ -712,11 +715,13 @@ namespace quickbook
         write_anchors(state, state.phrase);
 
         if (str == quickbook_get_date) {
+            ++state.time_dependent_output;
             char strdate[64];
             strftime(strdate, sizeof(strdate), "%Y-%b-%d", current_time);
             state.phrase << strdate;
         }
         else if (str == quickbook_get_time) {
+            ++state.time_dependent_output;
             char strdate[64];
             strftime(strdate, sizeof(strdate), "%I:%M:%S %p", current_time);
             state.phrase << strdate;
@@ -1074,6 +1079,7 @@ namespace quickbook
         }
 
         state.macro.add(macro_id.begin(), macro_id.end(), phrase);
+        state.macro_fingerprint.add(macro_id).add(phrase);
     }
 
     void template_body_action(
@@ -1208,30 +1214,21 @@ namespace quickbook
             }
         }
 
-        std::pair<bool, std::vector<std::string>::const_iterator> get_arguments(
+        bool get_arguments(
             std::vector<value> const& args,
             std::vector<std::string> const& params,
             template_scope const& scope,
             string_iterator first,
             quickbook::state& state)
         {
-            std::vector<value>::const_iterator arg = args.begin();
-            std::vector<std::string>::const_iterator tpl = params.begin();
-            std::vector<std::string> empty_params;
-
             // Store each of the argument passed in as local templates:
-            while (arg != args.end()) {
-                if (!state.templates.add(
-                        template_symbol(*tpl, empty_params, *arg, &scope))) {
-                    detail::outerr(state.current_file, first)
-                        << "Duplicate Symbol Found" << std::endl;
-                    ++state.error_count;
-                    return std::make_pair(false, tpl);
-                }
-                ++arg;
-                ++tpl;
+            if (!state.templates.add_arguments(params, args, &scope)) {
+                detail::outerr(state.current_file, first)
+                    << "Duplicate Symbol Found" << std::endl;
+                ++state.error_count;
+                return false;
             }
-            return std::make_pair(true, tpl);
+            return true;
         }
 
         bool parse_template(
@@ -1262,38 +1259,83 @@ namespace quickbook
         }
     }
 
-    void call_template(
-        quickbook::state& state,
-        template_symbol const* symbol,
-        std::vector<value> const& args,
-        string_iterator first,
-        bool is_attribute_template = false)
+    namespace
     {
-        bool is_block = symbol->content.get_tag() != template_tags::phrase;
-        assert(!(is_attribute_template && is_block));
-
-        quickbook::paragraph_action paragraph_action(state);
-
-        // Finish off any existing paragraphs.
-        if (is_block) paragraph_action();
+        // Records everything apart from the phrase output that expanding
+        // an argument might change, to check that its expansion can be
+        // reused.
+        struct expansion_check
+        {
+            explicit expansion_check(quickbook::state& state)
+                : error_count(state.error_count)
+                , diagnostic_count(detail::diagnostic_count())
+                , placeholder_count(state.document.placeholder_count())
+                , dependency_count(state.dependencies.count())
+                , glob_count(state.dependencies.glob_count())
+                , time_dependent_output(state.time_dependent_output)
+                , order_pos(state.order_pos)
+                , paragraph_count(state.paragraph_count)
+                , callout_depth(state.callout_depth)
+                , warned_about_breaks(state.warned_about_breaks)
+                , source_mode_next(state.source_mode_next)
+                , out_size(state.out.str().size())
+                , phrase_size(state.phrase.str().size())
+            {
+            }
 
-        // If this template contains already encoded text, then just
-        // write it out, without going through any of the rigamarole.
+            bool unchanged(quickbook::state& state) const
+            {
+                return state.error_count == error_count &&
+                       detail::diagnostic_count() == diagnostic_count &&
+                       state.document.placeholder_count() ==
+                           placeholder_count &&
+                       state.dependencies.count() == dependency_count &&
+                       state.dependencies.glob_count() == glob_count &&
+                       state.time_dependent_output == time_dependent_output &&
+                       state.order_pos == order_pos &&
+                       state.paragraph_count == paragraph_count &&
+                       state.callout_depth == callout_depth &&
+                       state.warned_about_breaks == warned_about_breaks &&
+                       state.source_mode_next == source_mode_next &&
+                       state.anchors.empty() && state.conditional &&
+                       state.out.str().size() == out_size &&
+                       state.phrase.str().size() >= phrase_size;
+            }
 
-        if (symbol->content.is_encoded()) {
-            (is_block ? state.out : state.phrase)
-                << symbol->content.get_encoded();
-            return;
-        }
+            int error_count;
+            unsigned diagnostic_count;
+            std::size_t placeholder_count;
+            std::size_t dependency_count;
+            std::size_t glob_count;
+            int time_dependent_output;
+            unsigned order_pos;
+            unsigned paragraph_count;
+            int callout_depth;
+            bool warned_about_breaks;
+            source_mode_type source_mode_next;
+            std::size_t out_size;
+            std::size_t phrase_size;
+        };
+
+        // Expand the template body in the current state. Returns false if
+        // there was an error.
+        bool expand_template(
+            quickbook::state& state,
+            template_symbol const* symbol,
+            std::vector<value> const& args,
+            string_iterator first,
+            bool is_attribute_template)
+        {
+            bool is_block = symbol->content.get_tag() != template_tags::phrase;
+            quickbook::paragraph_action paragraph_action(state);
 
-        // The template arguments should have the scope that the template was
-        // called from, not the template's own scope.
-        //
-        // Note that for quickbook 1.4- this value is just ignored when the
-        // arguments are expanded.
-        template_scope const& call_scope = state.templates.top_scope();
+            // The template arguments should have the scope that the template
+            // was called from, not the template's own scope.
+            //
+            // Note that for quickbook 1.4- this value is just ignored when
+            // the arguments are expanded.
+            template_scope const& call_scope = state.templates.top_scope();
 
-        {
             state_save save(state, state_save::scope_callables);
             std::string save_block;
             std::string save_phrase;
@@ -1307,7 +1349,7 @@ namespace quickbook
                 detail::outerr(state.current_file, first)
                     << "Infinite loop detected" << std::endl;
                 ++state.error_count;
-                return;
+                return false;
             }
 
             // Store the current section level so that we can ensure that
@@ -1316,13 +1358,8 @@ namespace quickbook
 
             ///////////////////////////////////
             // Prepare the arguments as local templates
-            bool get_arg_result;
-            std::vector<std::string>::const_iterator tpl;
-            boost::tie(get_arg_result, tpl) =
-                get_arguments(args, symbol->params, call_scope, first, state);
-
-            if (!get_arg_result) {
-                return;
+            if (!get_arguments(args, symbol->params, call_scope, first, state)) {
+                return false;
             }
 
             ///////////////////////////////////
@@ -1333,8 +1370,31 @@ namespace quickbook
                 state.phrase.swap(save_phrase);
             }
 
-            if (!parse_template(
-                    symbol->content, state, is_attribute_template)) {
+            if (state.profiler.enabled()) {
+                state.profiler.start(state.output_size());
+            }
+
+            bool parsed;
+            {
+                detail::expansion_site site(state.current_file, first);
+                parsed = parse_template(
+                    symbol->content, state, is_attribute_template);
+            }
+
+            if (state.profiler.enabled()) {
+                if (parsed) {
+                    quickbook::string_view body =
+                        symbol->content.get_quickbook();
+                    state.profiler.stop(
+                        symbol->content.get_file(), body.begin(), body.end(),
+                        state.output_size());
+                }
+                else {
+                    state.profiler.cancel();
+                }
+            }
+
+            if (!parsed) {
                 detail::outerr(state.current_file, first)
                     << "Expanding " << (is_block ? "block" : "phrase")
                     << " template: " << symbol->identifier << "\n\n"
@@ -1343,7 +1403,7 @@ namespace quickbook
                     << "------------------end--------------------\n"
                     << std::endl;
                 ++state.error_count;
-                return;
+                return false;
             }
 
             if (state.document.section_level() != state.min_section_level) {
@@ -1351,7 +1411,7 @@ namespace quickbook
                     << "Mismatched sections in template " << symbol->identifier
                     << std::endl;
                 ++state.error_count;
-                return;
+                return false;
             }
 
             if (symbol->content.get_file()->version() < 107u) {
@@ -1371,6 +1431,72 @@ namespace quickbook
             else {
                 if (is_block) paragraph_action();
             }
+
+            return true;
+        }
+    }
+
+    void call_template(
+        quickbook::state& state,
+        template_symbol const* symbol,
+        std::vector<value> const& args,
+        string_iterator first,
+        bool is_attribute_template = false)
+    {
+        bool is_block = symbol->content.get_tag() != template_tags::phrase;
+        assert(!(is_attribute_template && is_block));
+
+        quickbook::paragraph_action paragraph_action(state);
+
+        // Finish off any existing paragraphs.
+        if (is_block) paragraph_action();
+
+        // If this template contains already encoded text, then just
+        // write it out, without going through any of the rigamarole.
+
+        if (symbol->content.is_encoded()) {
+            (is_block ? state.out : state.phrase)
+                << symbol->content.get_encoded();
+            return;
+        }
+
+        // A phrase argument of the current template call is only expanded
+        // once if its expansion can be reused. In quickbook 1.4 arguments
+        // are dynamically scoped, so they're always expanded.
+        argument_expansion* expansion = 0;
+        if (!is_block && !is_attribute_template &&
+            symbol->content.get_file()->version() >= 105u &&
+            state.anchors.empty() && state.conditional &&
+            !state.templates.is_recording()) {
+            expansion = state.templates.find_expansion(symbol);
+        }
+
+        if (expansion && expansion->stored &&
+            expansion->source_mode ==
+                state.current_source_mode().source_mode &&
+            expansion->source_mode_next == state.source_mode_next &&
+            expansion->macros == state.macro_fingerprint.value()) {
+            state.phrase << expansion->output;
+            return;
+        }
+
+        if (!expansion) {
+            expand_template(state, symbol, args, first, is_attribute_template);
+            return;
+        }
+
+        expansion_check const check(state);
+
+        if (expand_template(
+                state, symbol, args, first, is_attribute_template) &&
+            check.unchanged(state)) {
+            std::string const& phrase = state.phrase.str();
+            expansion->stored = true;
+            expansion->source_mode = state.current_source_mode().source_mode;
+            expansion->source_mode_next = state.source_mode_next;
+            expansion->macros = state.macro_fingerprint.value();
+            expansion->output.assign(
+                phrase, check.phrase_size, std::string::npos);
         }
     }
 
@@ -1800,6 +1926,9 @@ namespace quickbook
         // Check this before qbk_version_n gets changed by the inner file.
         bool keep_inner_source_mode = (qbk_version_n < 106);
 
+        cached_include cache(state, path, load_type, include_doc_id);
+        if (cache.replayed()) return;
+
         {
             // When importing, state doesn't scope templates and macros so that
             // they're added to the existing scope. It might be better to add
@@ -1829,6 +1958,8 @@ namespace quickbook
             if (keep_inner_source_mode) save.source_mode = state.source_mode;
         }
 
+        cache.store();
+
         // restore the __FILENAME__ macro
         state.update_filename_macro();
     }
@@ -268,6 +268,9 @@ namespace quickbook
         bool nested_file);
     void post(quickbook::state& state, std::string const& doc_type);
 
+    // The last revision used when a document doesn't specify one.
+    std::string default_last_revision();
+
     struct to_value_scoped_action : scoped_action_base
     {
         to_value_scoped_action(quickbook::state& state_) : state(state_) {}
@@ -7,7 +7,9 @@ http://www.boost.org/LICENSE_1_0.txt)
 =============================================================================*/
 
 #include "bb2html.hpp"
+#include <algorithm>
 #include <cassert>
+#include <iterator>
 #include <vector>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -19,10 +21,12 @@ http://www.boost.org/LICENSE_1_0.txt)
 #include <boost/unordered_set.hpp>
 #include "boostbook_chunker.hpp"
 #include "files.hpp"
+#include "fingerprint.hpp"
 #include "for.hpp"
 #include "html_printer.hpp"
 #include "path.hpp"
 #include "post_process.hpp"
+#include "quickbook.hpp"
 #include "stream.hpp"
 #include "utils.hpp"
 #include "xml_parse.hpp"
@@ -68,6 +72,10 @@ namespace quickbook
         void generate_chunked_documentation(
             chunk*, ids_type const&, html_options const&);
         void generate_chunks(html_state&, chunk*);
+        bool generate_chunk_page(
+            html_state&, chunk*, fingerprint::value_type& written);
+        chunk* next_chunk(chunk*);
+        chunk* prev_chunk(chunk*);
         void generate_chunk_navigation(html_gen&, chunk*);
         void generate_inline_chunks(html_gen&, chunk*);
         void generate_chunk_body(html_gen&, chunk*);
@@ -82,8 +90,11 @@ namespace quickbook
         void generate_docinfo_html(html_gen&, xml_element*);
         void generate_tree_html(html_gen&, xml_element*);
         void generate_children_html(html_gen&, xml_element*);
-        void write_file(
-            html_state&, std::string const& path, std::string const& content);
+        bool write_file(
+            html_state&,
+            std::string const& path,
+            std::string const& content,
+            fingerprint::value_type& written);
         std::string get_link_from_path(
             html_gen&, quickbook::string_view, quickbook::string_view);
         std::string relative_path_or_url(html_gen&, path_or_url const&);
@@ -92,6 +103,18 @@ namespace quickbook
         std::string relative_path_from_url_paths(
             quickbook::string_view, quickbook::string_view);
 
+        void read_chunk_manifest(html_state&);
+        void write_chunk_manifest(html_state&);
+        fingerprint document_fingerprint(html_state&);
+        bool chunk_fingerprint(html_state&, chunk*, fingerprint&);
+        bool chunk_unchanged(html_state&, chunk*, fingerprint);
+        void add_chunk_fingerprint(html_state&, fingerprint&, chunk*);
+        bool add_toc_fingerprint(html_state&, fingerprint&, chunk*);
+        void add_tree_fingerprint(html_state&, fingerprint&, xml_element*);
+        void add_link_fingerprint(
+            html_state&, fingerprint&, quickbook::string_view);
+        bool contains_element(xml_element*, quickbook::string_view name);
+
         ids_type get_id_paths(chunk* chunk);
         void get_id_paths_impl(ids_type&, chunk*);
         void get_id_paths_impl2(ids_type&, chunk*, xml_element*);
@@ -137,15 +160,40 @@ namespace quickbook
             }
         };
 
+        // What was generated for a page in a previous run, read from
+        // the chunk manifest.
+        struct chunk_record
+        {
+            fingerprint::value_type page_fingerprint;
+            fingerprint::value_type output_fingerprint;
+            unsigned footnotes; // The number of footnotes on the page.
+        };
+
+        typedef boost::unordered_map<std::string, chunk_record> chunk_manifest;
+
         struct html_state
         {
             ids_type const& ids;
             html_options const& options;
             unsigned int error_count;
+            unsigned int warning_count;
+            unsigned int footnote_number;
+
+            // Only used for chunked output.
+            fingerprint::value_type document_fingerprint;
+            chunk_manifest previous_chunks;
+            chunk_manifest chunks;
 
             explicit html_state(
                 ids_type const& ids_, html_options const& options_)
-                : ids(ids_), options(options_), error_count(0)
+                : ids(ids_)
+                , options(options_)
+                , error_count(0)
+                , warning_count(0)
+                , footnote_number(0)
+                , document_fingerprint(0)
+                , previous_chunks()
+                , chunks()
             {
             }
         };
@@ -255,9 +303,17 @@ namespace quickbook
             }
             ids_type ids = get_id_paths(chunked.root());
             html_state state(ids, options);
+            if (options.chunked_output) {
+                read_chunk_manifest(state);
+                state.document_fingerprint =
+                    document_fingerprint(state).value();
+            }
             if (chunked.root()) {
                 generate_chunks(state, chunked.root());
             }
+            if (options.chunked_output) {
+                write_chunk_manifest(state);
+            }
             return state.error_count;
         }
 
@@ -312,6 +368,44 @@ namespace quickbook
         }
 
         void generate_chunks(html_state& state, chunk* x)
+        {
+            fingerprint fp;
+            if (state.options.chunked_output &&
+                chunk_fingerprint(state, x, fp)) {
+                if (!chunk_unchanged(state, x, fp)) {
+                    // Pages with warnings aren't recorded, so that the
+                    // warnings are repeated in the next run.
+                    unsigned footnote_start = state.footnote_number;
+                    unsigned warning_start = state.warning_count;
+                    fingerprint::value_type written;
+                    if (generate_chunk_page(state, x, written) &&
+                        state.warning_count == warning_start) {
+                        chunk_record& record = state.chunks[x->path_];
+                        record.page_fingerprint = fp.value();
+                        record.output_fingerprint = written;
+                        record.footnotes =
+                            state.footnote_number - footnote_start;
+                    }
+                }
+            }
+            else {
+                fingerprint::value_type written;
+                generate_chunk_page(state, x, written);
+            }
+
+            chunk* it = x->children();
+            for (; it && it->inline_; it = it->next()) {
+            }
+            for (; it; it = it->next()) {
+                assert(!it->inline_);
+                generate_chunks(state, it);
+            }
+        }
+
+        // Returns true if the page was written without any errors, and
+        // sets 'written' to the fingerprint of the file's contents.
+        bool generate_chunk_page(
+            html_state& state, chunk* x, fingerprint::value_type& written)
         {
             chunk_state c_state;
             gather_chunk_ids(c_state, x);
@@ -332,33 +426,28 @@ namespace quickbook
             open_tag(gen.printer, "body");
             generate_chunk_navigation(gen, x);
             generate_chunk_body(gen, x);
-            chunk* it = x->children();
-            for (; it && it->inline_; it = it->next()) {
+            for (chunk* it = x->children(); it && it->inline_;
+                 it = it->next()) {
                 generate_inline_chunks(gen, it);
             }
             generate_footnotes_html(gen);
             close_tag(gen.printer, "body");
             close_tag(gen.printer, "html");
-            write_file(state, x->path_, gen.printer.html);
-            for (; it; it = it->next()) {
-                assert(!it->inline_);
-                generate_chunks(state, it);
-            }
+            return write_file(state, x->path_, gen.printer.html, written);
         }
 
-        void generate_chunk_navigation(html_gen& gen, chunk* x)
+        chunk* next_chunk(chunk* x)
         {
-            chunk* next = 0;
             for (chunk* it = x->children(); it; it = it->next()) {
                 if (!it->inline_) {
-                    next = it;
-                    break;
+                    return it;
                 }
             }
-            if (!next) {
-                next = x->next();
-            }
+            return x->next();
+        }
 
+        chunk* prev_chunk(chunk* x)
+        {
             chunk* prev = x->prev();
             if (prev) {
                 while (prev->children()) {
@@ -370,6 +459,13 @@ namespace quickbook
             else {
                 prev = x->parent();
             }
+            return prev;
+        }
+
+        void generate_chunk_navigation(html_gen& gen, chunk* x)
+        {
+            chunk* next = next_chunk(x);
+            chunk* prev = prev_chunk(x);
 
             if (next || prev || x->parent()) {
                 tag_start(gen.printer, "div");
@@ -689,14 +785,16 @@ namespace quickbook
             }
         }
 
-        void write_file(
+        bool write_file(
             html_state& state,
             std::string const& generic_path,
-            std::string const& content)
+            std::string const& content,
+            fingerprint::value_type& written)
         {
             fs::path path = state.options.home_path.parent_path() /
                             generic_to_path(generic_path);
             std::string html = content;
+            bool success = true;
 
             if (state.options.pretty_print) {
                 try {
@@ -705,6 +803,7 @@ namespace quickbook
                     ::quickbook::detail::outerr(path)
                         << "Post Processing Failed." << std::endl;
                     ++state.error_count;
+                    success = false;
                 }
             }
 
@@ -720,7 +819,7 @@ namespace quickbook
                 ::quickbook::detail::outerr(path)
                     << "Error opening output file" << std::endl;
                 ++state.error_count;
-                return;
+                return false;
             }
 
             fileout << html;
@@ -729,8 +828,11 @@ namespace quickbook
                 ::quickbook::detail::outerr(path)
                     << "Error writing to output file" << std::endl;
                 ++state.error_count;
-                return;
+                return false;
             }
+
+            written = fingerprint().add(html).value();
+            return success;
         }
 
         std::string get_link_from_path(
@@ -824,6 +926,269 @@ namespace quickbook
             return result;
         }
 
+        // Chunk manifest
+        //
+        // When generating chunked output, the fingerprint of everything
+        // that's used to generate each page is stored in a manifest in the
+        // output directory. If a page's fingerprint matches the previous
+        // run, and its file hasn't been changed since it was written, it
+        // isn't generated again.
+        //
+        // The fingerprint covers the page's own elements, the paths of
+        // anything that it links to, the titles of the pages in its table
+        // of contents, its navigation links, the html options and the
+        // number of footnotes that come before it.
+
+        char const* const chunk_manifest_name = ".quickbook-chunks";
+
+        // Change this whenever the manifest format, or anything else that
+        // affects the fingerprints, changes.
+        char const* const chunk_manifest_format = "quickbook chunk manifest 1";
+
+        void read_chunk_manifest(html_state& state)
+        {
+            fs::path path =
+                state.options.home_path.parent_path() / chunk_manifest_name;
+            fs::ifstream in(path);
+            if (!in) {
+                return;
+            }
+
+            std::string line;
+            if (!std::getline(in, line) || line != chunk_manifest_format) {
+                return;
+            }
+
+            chunk_record record;
+            while (in >> record.page_fingerprint >> record.output_fingerprint >>
+                   record.footnotes) {
+                if (in.get() != ' ' || !std::getline(in, line)) {
+                    state.previous_chunks.clear();
+                    return;
+                }
+                state.previous_chunks[line] = record;
+            }
+        }
+
+        void write_chunk_manifest(html_state& state)
+        {
+            fs::path path =
+                state.options.home_path.parent_path() / chunk_manifest_name;
+            fs::path tmp_path = path;
+            tmp_path += ".tmp";
+
+            std::vector<chunk_manifest::value_type const*> records;
+            QUICKBOOK_FOR (chunk_manifest::value_type const& x, state.chunks) {
+                if (x.first.find('\n') == std::string::npos) {
+                    records.push_back(&x);
+                }
+            }
+            std::sort(
+                records.begin(), records.end(),
+                [](chunk_manifest::value_type const* x,
+                   chunk_manifest::value_type const* y) {
+                    return x->first < y->first;
+                });
+
+            // The manifest is just an optimization, so failing to write it
+            // isn't an error.
+            boost::system::error_code ec;
+            {
+                fs::ofstream out(tmp_path);
+                if (!out) {
+                    return;
+                }
+                out << chunk_manifest_format << '\n';
+                QUICKBOOK_FOR (auto const* x, records) {
+                    out << x->second.page_fingerprint << ' '
+                        << x->second.output_fingerprint << ' '
+                        << x->second.footnotes << ' ' << x->first << '\n';
+                }
+                out.close();
+                if (out.fail()) {
+                    fs::remove(tmp_path, ec);
+                    return;
+                }
+            }
+            fs::rename(tmp_path, path, ec);
+            if (ec) {
+                fs::remove(tmp_path, ec);
+            }
+        }
+
+        std::string path_or_url_string(path_or_url const& x)
+        {
+            return !x ? std::string()
+                      : x.is_url() ? "url:" + x.get_url()
+                                   : "path:" + path_to_generic(x.get_path());
+        }
+
+        fingerprint document_fingerprint(html_state& state)
+        {
+            fingerprint result;
+            result.add(chunk_manifest_format)
+                .add(QUICKBOOK_VERSION)
+                .add(path_to_generic(fs::current_path()))
+                .add(path_to_generic(state.options.home_path))
+                .add(path_or_url_string(state.options.boost_root_path))
+                .add(path_or_url_string(state.options.css_path))
+                .add(path_or_url_string(state.options.graphics_path))
+                .add(static_cast<fingerprint::value_type>(
+                    state.options.pretty_print));
+            return result;
+        }
+
+        // Returns false if the page can't be skipped, because generating it
+        // changes elements which belong to other pages. This happens when
+        // a footnote is in a title that's in the table of contents, as
+        // footnotes are given ids when they're written.
+        bool chunk_fingerprint(html_state& state, chunk* x, fingerprint& result)
+        {
+            result = fingerprint(state.document_fingerprint);
+            result.add(x->path_).add(
+                static_cast<fingerprint::value_type>(state.footnote_number));
+
+            chunk* next = next_chunk(x);
+            chunk* prev = prev_chunk(x);
+            result.add(next ? next->path_ : std::string())
+                .add(prev ? prev->path_ : std::string())
+                .add(x->parent() ? x->parent()->path_ : std::string());
+
+            add_chunk_fingerprint(state, result, x);
+            return add_toc_fingerprint(state, result, x);
+        }
+
+        bool chunk_unchanged(html_state& state, chunk* x, fingerprint fp)
+        {
+            chunk_manifest::const_iterator it =
+                state.previous_chunks.find(x->path_);
+            if (it == state.previous_chunks.end() ||
+                it->second.page_fingerprint != fp.value()) {
+                return false;
+            }
+
+            fs::path path = state.options.home_path.parent_path() /
+                            generic_to_path(x->path_);
+            fs::ifstream in(path, std::ios_base::binary);
+            if (!in) {
+                return false;
+            }
+            std::string contents(
+                (std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+            if (in.bad() ||
+                fingerprint().add(contents).value() !=
+                    it->second.output_fingerprint) {
+                return false;
+            }
+
+            state.footnote_number += it->second.footnotes;
+            state.chunks[x->path_] = it->second;
+            return true;
+        }
+
+        // The page's elements, including inline chunks.
+        void add_chunk_fingerprint(
+            html_state& state, fingerprint& result, chunk* x)
+        {
+            result.add(x->id_).add(
+                static_cast<fingerprint::value_type>(x->inline_));
+            add_tree_fingerprint(state, result, x->title_.root());
+            add_tree_fingerprint(state, result, x->info_.root());
+            add_tree_fingerprint(state, result, x->contents_.root());
+
+            for (chunk* it = x->children(); it && it->inline_;
+                 it = it->next()) {
+                result.add(static_cast<fingerprint::value_type>(1));
+                add_chunk_fingerprint(state, result, it);
+            }
+            result.add(static_cast<fingerprint::value_type>(0));
+        }
+
+        // The titles of every descendant, as they might appear in the table
+        // of contents.
+        bool add_toc_fingerprint(
+            html_state& state, fingerprint& result, chunk* x)
+        {
+            bool cacheable = true;
+            for (chunk* it = x->children(); it; it = it->next()) {
+                result.add(static_cast<fingerprint::value_type>(1))
+                    .add(it->contents_.root()->name_);
+                add_link_fingerprint(state, result, it->id_);
+                add_tree_fingerprint(state, result, it->title_.root());
+                if (!it->inline_ &&
+                    contains_element(it->title_.root(), "footnote")) {
+                    cacheable = false;
+                }
+                if (!add_toc_fingerprint(state, result, it)) {
+                    cacheable = false;
+                }
+            }
+            result.add(static_cast<fingerprint::value_type>(0));
+            return cacheable;
+        }
+
+        void add_tree_fingerprint(
+            html_state& state, fingerprint& result, xml_element* x)
+        {
+            if (!x) {
+                result.add(static_cast<fingerprint::value_type>(0));
+                return;
+            }
+
+            result.add(static_cast<fingerprint::value_type>(x->type_ + 1))
+                .add(x->name_)
+                .add(x->contents_)
+                .add(static_cast<fingerprint::value_type>(
+                    x->attributes().size()));
+            QUICKBOOK_FOR (auto const& attribute, x->attributes()) {
+                // The html doesn't use 'last-revision', and it's usually
+                // the current time, which would change every fingerprint.
+                if (attribute.first != "last-revision") {
+                    result.add(attribute.first).add(attribute.second);
+                }
+                if (attribute.first == "linkend" ||
+                    attribute.first == "linkends") {
+                    add_link_fingerprint(state, result, attribute.second);
+                }
+            }
+
+            for (xml_element* it = x->children(); it; it = it->next()) {
+                add_tree_fingerprint(state, result, it);
+            }
+            result.add(static_cast<fingerprint::value_type>(0));
+        }
+
+        // Where a link to the id goes.
+        void add_link_fingerprint(
+            html_state& state, fingerprint& result, quickbook::string_view id)
+        {
+            ids_type::const_iterator it = state.ids.find(id);
+            if (it == state.ids.end()) {
+                result.add(static_cast<fingerprint::value_type>(0));
+            }
+            else {
+                result.add(static_cast<fingerprint::value_type>(1))
+                    .add(it->second.path());
+            }
+        }
+
+        bool contains_element(xml_element* x, quickbook::string_view name)
+        {
+            if (!x) {
+                return false;
+            }
+            if (x->type_ == xml_element::element_node && x->name_ == name) {
+                return true;
+            }
+            for (xml_element* it = x->children(); it; it = it->next()) {
+                if (contains_element(it, name)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
         // get_id_paths
 
         ids_type get_id_paths(chunk* chunk)
@@ -1051,6 +1416,7 @@ namespace quickbook
                     detail::outwarn(docbook)
                         << "link not found: " << x->get_attribute("linkend")
                         << std::endl;
+                    ++gen.state.warning_count;
                 }
             }
 
@@ -1381,10 +1747,9 @@ namespace quickbook
         NODE_RULE(footnote, gen, x)
         {
             // TODO: Better id generation....
-            static int footnote_number = 0;
-            ++footnote_number;
+            ++gen.state.footnote_number;
             std::string footnote_label =
-                boost::lexical_cast<std::string>(footnote_number);
+                boost::lexical_cast<std::string>(gen.state.footnote_number);
             auto footnote_id =
                 generate_id(gen.chunk, x, "(((footnote-id)))", "footnote");
             if (!x->has_attribute("id")) {
@@ -30,30 +30,44 @@ namespace quickbook
         return *this;
     }
 
-    collector::collector() : main(default_), top(default_) {}
+    collector::collector() : streams(), depth(0), main(default_), top(default_)
+    {
+    }
 
-    collector::collector(string_stream& out) : main(out), top(out) {}
+    collector::collector(string_stream& out)
+        : streams(), depth(0), main(out), top(out)
+    {
+    }
 
     collector::~collector()
     {
-        BOOST_ASSERT(
-            streams.empty()); // assert there are no more pushes than pops!!!
+        BOOST_ASSERT(depth == 0); // assert there are no more pushes than pops!!!
     }
 
     void collector::push()
     {
-        streams.push(string_stream());
-        top = boost::ref(streams.top());
+        if (depth == streams.size()) {
+            streams.push_back(string_stream());
+        }
+        else {
+            // Flush before clearing, so that nothing left in the stream's
+            // buffer is written after the clear.
+            streams[depth].get().flush();
+            streams[depth].clear();
+        }
+
+        top = boost::ref(streams[depth]);
+        ++depth;
     }
 
     void collector::pop()
     {
-        BOOST_ASSERT(!streams.empty());
-        streams.pop();
+        BOOST_ASSERT(depth != 0);
+        --depth;
 
-        if (streams.empty())
+        if (depth == 0)
             top = boost::ref(main);
         else
-            top = boost::ref(streams.top());
+            top = boost::ref(streams[depth - 1]);
     }
 }
@@ -9,8 +9,8 @@
 #if !defined(BOOST_SPIRIT_QUICKBOOK_COLLECTOR_HPP)
 #define BOOST_SPIRIT_QUICKBOOK_COLLECTOR_HPP
 
-#include <stack>
 #include <string>
+#include <vector>
 #include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/noncopyable.hpp>
@@ -74,7 +74,10 @@ namespace quickbook
         void append(std::string const& other) { top.get().append(other); }
 
       private:
-        std::stack<string_stream> streams;
+        // Popped streams are kept for reuse, as creating a stream is
+        // relatively expensive. 'depth' is the number in use.
+        std::vector<string_stream> streams;
+        std::size_t depth;
         boost::reference_wrapper<string_stream> main;
         boost::reference_wrapper<string_stream> top;
         string_stream default_;
@@ -0,0 +1,590 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "dependency_scanner.hpp"
+#include <set>
+#include <utility>
+#include <boost/range/algorithm/replace.hpp>
+#include "files.hpp"
+#include "for.hpp"
+#include "glob.hpp"
+#include "include_paths.hpp"
+#include "path.hpp"
+#include "quickbook.hpp"
+#include "state.hpp"
+
+namespace quickbook
+{
+    namespace
+    {
+        typedef quickbook::string_view::size_type size_type;
+        size_type const npos = quickbook::string_view::npos;
+
+        // Thrown when the scan finds something that needs a full parse.
+        struct scan_failure
+        {
+        };
+
+        bool is_space(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        bool is_name_char(char c)
+        {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                   (c >= '0' && c <= '9') || c == '_' || c == '-';
+        }
+
+        bool is_doc_type(quickbook::string_view name)
+        {
+            static char const* const doc_types[] = {
+                "book",     "article",  "library",   "chapter",
+                "part",     "appendix", "preface",   "qandadiv",
+                "qandaset", "reference", "set"};
+
+            QUICKBOOK_FOR (char const* type, doc_types) {
+                if (name == type) return true;
+            }
+
+            return false;
+        }
+
+        // Skip over an element, including any nested square brackets, e.g.
+        // a comment. 'pos' is the position of the opening bracket.
+        size_type skip_element(quickbook::string_view source, size_type pos)
+        {
+            int depth = 0;
+
+            for (; pos < source.size(); ++pos) {
+                switch (source[pos]) {
+                case '\\':
+                    ++pos;
+                    break;
+                case '[':
+                    ++depth;
+                    break;
+                case ']':
+                    if (--depth == 0) return pos + 1;
+                    break;
+                }
+            }
+
+            return source.size();
+        }
+
+        // Skip whitespace and comments.
+        size_type skip_space(quickbook::string_view source, size_type pos)
+        {
+            for (;;) {
+                while (pos < source.size() && is_space(source[pos])) {
+                    ++pos;
+                }
+
+                if (source.substr(pos, 2) != "[/") return pos;
+                pos = skip_element(source, pos);
+            }
+        }
+
+        // Read the name of the element which starts at 'pos', returns the
+        // position after the name.
+        size_type element_name(
+            quickbook::string_view source,
+            size_type pos,
+            quickbook::string_view& name)
+        {
+            name = quickbook::string_view();
+            if (pos >= source.size() || source[pos] != '[') return pos;
+
+            size_type begin = skip_space(source, pos + 1);
+            size_type end = begin;
+            while (end < source.size() && is_name_char(source[end])) {
+                ++end;
+            }
+
+            name = quickbook::string_view(source.data() + begin, end - begin);
+            return end;
+        }
+
+        // Read the value of a '[quickbook x.y]' attribute, 'pos' is the
+        // position after the attribute name.
+        unsigned read_version(quickbook::string_view source, size_type pos)
+        {
+            pos = skip_space(source, pos);
+
+            unsigned major = 0, minor = 0, digits = 0;
+            while (pos < source.size() && source[pos] >= '0' &&
+                   source[pos] <= '9') {
+                major = major * 10 + (source[pos++] - '0');
+                ++digits;
+            }
+            if (!digits || source.substr(pos, 1) != ".") throw scan_failure();
+
+            ++pos;
+            digits = 0;
+            while (pos < source.size() && source[pos] >= '0' &&
+                   source[pos] <= '9' && digits < 2) {
+                minor = minor * 10 + (source[pos++] - '0');
+                ++digits;
+            }
+            if (!digits) throw scan_failure();
+
+            return major * 100 + minor;
+        }
+
+        // Find a file's quickbook version, using the same rules as
+        // 'pre' in doc_info_actions.cpp.
+        unsigned file_version(
+            quickbook::string_view source, unsigned parent_version, bool nested)
+        {
+            unsigned version = 0;
+            quickbook::string_view name;
+            size_type pos = skip_space(source, 0);
+            size_type end = element_name(source, pos, name);
+
+            // Attributes before the document info block are always used.
+            while (name == "quickbook" || name == "compatibility-mode" ||
+                   name == "source-mode") {
+                if (name == "quickbook" && !version) {
+                    version = read_version(source, end);
+                }
+
+                pos = skip_space(source, skip_element(source, pos));
+                end = element_name(source, pos, name);
+            }
+
+            if (!is_doc_type(name)) {
+                // A full parse will report the missing document info.
+                if (!nested) throw scan_failure();
+                return version ? version : parent_version;
+            }
+
+            // Attributes inside the block are ignored by nested pre-1.6
+            // files.
+            bool use_doc_info = !nested || parent_version >= 106u;
+
+            if (use_doc_info && !version) {
+                size_type block_end = skip_element(source, pos);
+
+                for (pos = end; pos < block_end; ++pos) {
+                    if (source[pos] == '\\') {
+                        ++pos;
+                    }
+                    else if (source[pos] == '[') {
+                        end = element_name(source, pos, name);
+                        if (name == "quickbook") {
+                            version = read_version(source, end);
+                            break;
+                        }
+                        pos = skip_element(source, pos) - 1;
+                    }
+                }
+            }
+
+            return version ? version : use_doc_info ? 101u : parent_version;
+        }
+
+        // Skip inline code, or a code block in backticks.
+        size_type skip_code(quickbook::string_view source, size_type pos)
+        {
+            if (source.substr(pos, 2) == "``") {
+                size_type end = source.find("``", pos + 2);
+                return end == npos ? pos + 2 : end + 2;
+            }
+
+            // Inline code doesn't run past the end of a paragraph.
+            size_type end = source.find('`', pos + 1);
+            size_type paragraph_end = source.find("\n\n", pos + 1);
+            return end == npos || end > paragraph_end ? pos + 1 : end + 1;
+        }
+
+        // Tracks the syntactic blocks at the top level of a file, as
+        // indented lines are code blocks, which aren't parsed.
+        struct top_level_blocks
+        {
+            top_level_blocks() : block_start(true), list_indent(-1) {}
+
+            // At the start of a block, i.e. after a blank line.
+            bool block_start;
+            // The indentation of the current list item's text, or -1 when
+            // not in a list.
+            int list_indent;
+        };
+
+        // Skip spaces and tabs, adding their width to 'indent'.
+        size_type skip_indent(
+            quickbook::string_view source, size_type pos, int& indent)
+        {
+            for (; pos < source.size(); ++pos) {
+                if (source[pos] == ' ') {
+                    ++indent;
+                }
+                else if (source[pos] == '\t') {
+                    indent = indent + 4 - (indent % 4);
+                }
+                else {
+                    break;
+                }
+            }
+
+            return pos;
+        }
+
+        bool at_line_end(quickbook::string_view source, size_type pos)
+        {
+            return pos == source.size() || source[pos] == '\n' ||
+                   source[pos] == '\r';
+        }
+
+        // Called at the start of a line at the top level, returns the
+        // position to carry on scanning from, which is after any code
+        // block. This is a simplified version of the indentation checks
+        // in main_grammar.cpp.
+        size_type scan_line(
+            quickbook::string_view source,
+            size_type pos,
+            unsigned version,
+            top_level_blocks& blocks)
+        {
+            int indent = 0;
+            size_type text = skip_indent(source, pos, indent);
+
+            if (at_line_end(source, text)) {
+                blocks.block_start = true;
+                return pos;
+            }
+
+            bool list_item = source[text] == '*' || source[text] == '#';
+
+            // Lines in the middle of a paragraph, except for list items.
+            if (!blocks.block_start &&
+                !(list_item && blocks.list_indent >= 0)) {
+                return pos;
+            }
+
+            blocks.block_start = false;
+
+            if (list_item && (blocks.list_indent >= 0 || !indent)) {
+                skip_indent(source, text + 1, ++indent);
+                blocks.list_indent = indent;
+                return pos;
+            }
+
+            if (version < 106u || !indent) blocks.list_indent = -1;
+            int code_indent = blocks.list_indent >= 0 ? blocks.list_indent : 0;
+            if (indent <= code_indent) return pos;
+
+            // Skip the code block, which continues until a line that isn't
+            // blank or indented.
+            while (pos < source.size()) {
+                indent = 0;
+                text = skip_indent(source, pos, indent);
+                if (!at_line_end(source, text) && indent <= code_indent) break;
+
+                pos = source.find('\n', text);
+                pos = pos == npos ? source.size() : pos + 1;
+            }
+
+            blocks.block_start = true;
+            return pos;
+        }
+
+        struct dependency_scanner
+        {
+            explicit dependency_scanner(quickbook::state& state_)
+                : state(state_), scanned()
+            {
+            }
+
+            void scan_file(unsigned parent_version, bool nested, bool imported);
+            size_type scan_element(
+                quickbook::string_view source,
+                size_type pos,
+                unsigned version,
+                bool imported);
+            void scan_include(
+                quickbook::string_view name,
+                std::string const& path,
+                unsigned version,
+                bool imported);
+            void scan_image(quickbook::string_view fileref, unsigned version);
+
+            quickbook::state& state;
+
+            // Files that have already been scanned, along with the version
+            // they were scanned as, and whether they were imported.
+            std::set<std::pair<fs::path, std::pair<unsigned, bool> > > scanned;
+        };
+
+        void dependency_scanner::scan_file(
+            unsigned parent_version, bool nested, bool imported)
+        {
+            quickbook::string_view source = state.current_file->source();
+            unsigned version = file_version(source, parent_version, nested);
+
+            if (!scanned
+                     .insert(std::make_pair(
+                         state.current_file->path,
+                         std::make_pair(version, imported)))
+                     .second) {
+                return;
+            }
+
+            size_type pos = 0;
+            int depth = 0;
+            top_level_blocks blocks;
+
+            while (pos < source.size()) {
+                if (!depth && (!pos || source[pos - 1] == '\n')) {
+                    size_type next = scan_line(source, pos, version, blocks);
+                    if (next != pos) {
+                        pos = next;
+                        continue;
+                    }
+                }
+
+                switch (source[pos]) {
+                case '\\':
+                    pos += 2;
+                    break;
+                case '\'':
+                    if (source.substr(pos, 3) == "'''") {
+                        size_type end = source.find("'''", pos + 3);
+                        pos = end == npos ? source.size() : end + 3;
+                    }
+                    else {
+                        ++pos;
+                    }
+                    break;
+                case '`':
+                    pos = skip_code(source, pos);
+                    break;
+                case '[': {
+                    // Elements which aren't skipped are scanned from the next
+                    // character, so keep track of how deeply nested they are.
+                    size_type next =
+                        scan_element(source, pos, version, imported);
+                    if (next == pos + 1) ++depth;
+                    pos = next;
+                    break;
+                }
+                case ']':
+                    if (depth) --depth;
+                    ++pos;
+                    break;
+                default:
+                    ++pos;
+                }
+            }
+        }
+
+        size_type dependency_scanner::scan_element(
+            quickbook::string_view source,
+            size_type pos,
+            unsigned version,
+            bool imported)
+        {
+            if (source.substr(pos, 2) == "[/") {
+                return skip_element(source, pos);
+            }
+
+            quickbook::string_view name;
+            size_type end = element_name(source, pos, name);
+
+            if (name.empty()) {
+                if (source.substr(end, 1) == "$") {
+                    size_type fileref_end = source.find_first_of(
+                        version >= 105u ? "[]" : "]", end + 1);
+                    if (fileref_end != npos) {
+                        scan_image(
+                            quickbook::string_view(
+                                source.data() + end + 1,
+                                fileref_end - end - 1),
+                            version);
+                    }
+                }
+
+                // Carry on scanning inside the element.
+                return pos + 1;
+            }
+
+            if (name != "include" && name != "import" && name != "xinclude") {
+                return pos + 1;
+            }
+
+            // Skip the id.
+            if (name == "include" && source.substr(end, 1) == ":") {
+                ++end;
+                while (end < source.size() && is_name_char(source[end]) &&
+                       source[end] != '-') {
+                    ++end;
+                }
+            }
+
+            size_type path_begin = skip_space(source, end);
+            size_type path_end = source.find(']', path_begin);
+            if (path_end == npos) throw scan_failure();
+
+            quickbook::string_view path(
+                source.data() + path_begin, path_end - path_begin);
+
+            // Paths are plain text, except that 1.6 and later have escapes,
+            // and in 1.7 they can be generated by templates. Leave anything
+            // like that to the full parse.
+            if (path.find("\n\n") != npos ||
+                (version >= 106u &&
+                 (path.find_first_of("\\[") != npos ||
+                  path.find("'''") != npos))) {
+                throw scan_failure();
+            }
+
+            if (version >= 107u) {
+                while (!path.empty() && is_space(path[path.size() - 1])) {
+                    path.remove_suffix(1);
+                }
+
+                for (size_type i = 0; i < path.size(); ++i) {
+                    if (is_space(path[i])) throw scan_failure();
+                }
+            }
+
+            // Not really an include, e.g. a table cell that just contains
+            // '[include]'.
+            if (path.empty()) return pos + 1;
+
+            // xinclude just writes out the path, so doesn't have any
+            // dependencies.
+            if (name != "xinclude") {
+                std::string path_text = path.to_s();
+                if (version < 106u) boost::replace(path_text, '\\', '/');
+                scan_include(name, path_text, version, imported);
+            }
+
+            return path_end + 1;
+        }
+
+        void dependency_scanner::scan_include(
+            quickbook::string_view name,
+            std::string const& path,
+            unsigned version,
+            bool imported)
+        {
+            path_parameter parameter(path, path_parameter::path);
+
+            if (version >= 107u) {
+                try {
+                    if (check_glob(path)) {
+                        parameter.type = path_parameter::glob;
+                    }
+                    else {
+                        parameter.value = glob_unescape(path);
+                    }
+                } catch (glob_error&) {
+                    throw scan_failure();
+                }
+            }
+
+            std::set<quickbook_path> search;
+            if (parameter.type == path_parameter::glob) {
+                search = include_search(
+                    parameter, state, state.current_file->source().begin());
+            }
+            else if (!search_include_path(search, parameter.value, state)) {
+                throw scan_failure();
+            }
+
+            // Same as 'include_action'.
+            QUICKBOOK_FOR (quickbook_path const& p, search) {
+                bool quickbook_file;
+
+                if (version >= 106u) {
+                    if (imported && name == "include") return;
+
+                    std::string ext = p.file_path.extension().generic_string();
+                    quickbook_file = ext == ".qbk" || ext == ".quickbook";
+                }
+                else {
+                    quickbook_file = name == "include";
+                }
+
+                if (quickbook_file) {
+                    file_ptr saved_file = state.current_file;
+                    quickbook_path saved_path = state.current_path;
+
+                    try {
+                        state.current_file = load(p.file_path);
+                    } catch (load_error&) {
+                        throw scan_failure();
+                    }
+
+                    state.current_path = p;
+                    scan_file(version, true, name == "import");
+
+                    state.current_file = saved_file;
+                    state.current_path = saved_path;
+                }
+            }
+        }
+
+        // Only SVG files are read, to get their size.
+        void dependency_scanner::scan_image(
+            quickbook::string_view fileref, unsigned version)
+        {
+            while (!fileref.empty() && is_space(fileref[0])) {
+                fileref.remove_prefix(1);
+            }
+
+            if (version >= 105u) {
+                while (!fileref.empty() &&
+                       is_space(fileref[fileref.size() - 1])) {
+                    fileref.remove_suffix(1);
+                }
+            }
+
+            if (fileref.find("\n\n") != npos) return;
+            if (version >= 106u && (fileref.find('\\') != npos ||
+                                    fileref.find("'''") != npos)) {
+                throw scan_failure();
+            }
+
+            std::string path = fileref.to_s();
+            boost::replace(path, '\\', '/');
+
+            std::string::size_type pos = path.rfind('/');
+            std::string stem =
+                pos == std::string::npos ? path : path.substr(pos + 1);
+
+            pos = stem.rfind('.');
+            if (pos == std::string::npos || stem.substr(pos + 1) != "svg") {
+                return;
+            }
+
+            // Image paths are relative to the html subdirectory.
+            fs::path img = detail::generic_to_path(path);
+            if (!img.has_root_directory()) img = quickbook::image_location / img;
+
+            state.dependencies.add_dependency(img);
+        }
+    }
+
+    bool scan_dependencies(quickbook::state& state)
+    {
+        file_ptr file = state.current_file;
+        quickbook_path path = state.current_path;
+
+        try {
+            dependency_scanner scanner(state);
+            scanner.scan_file(qbk_version_n, false, false);
+            return true;
+        } catch (scan_failure&) {
+            state.current_file = file;
+            state.current_path = path;
+            return false;
+        }
+    }
+}
@@ -0,0 +1,32 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(QUICKBOOK_DEPENDENCY_SCANNER_HPP)
+#define QUICKBOOK_DEPENDENCY_SCANNER_HPP
+
+#include "fwd.hpp"
+
+namespace quickbook
+{
+    // Find the files that the current file depends on, without parsing it.
+    //
+    // This only recognises the document info, and the elements which read
+    // other files - include, import, xinclude and images - so templates
+    // aren't expanded, ids aren't generated and nothing is written. It
+    // might find some files which a full parse wouldn't use, e.g. if they're
+    // included in a template which is never called.
+    //
+    // Returns false if it finds something that it can't deal with, such as
+    // a path generated by a template, or a file that can't be found. The
+    // dependencies that have been added are then incomplete, so the
+    // document needs to be parsed as normal.
+
+    bool scan_dependencies(quickbook::state&);
+}
+
+#endif
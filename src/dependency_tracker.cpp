@@ -7,6 +7,7 @@
 =============================================================================*/
 
 #include "dependency_tracker.hpp"
+#include <cassert>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/operations.hpp>
 #include "for.hpp"
@@ -57,6 +58,10 @@ namespace quickbook
         : dependencies()
         , glob_dependencies()
         , last_glob(glob_dependencies.end())
+        , history_()
+        , recording_(0)
+        , count_(0)
+        , glob_count_(0)
     {
     }
 
@@ -64,14 +69,29 @@ namespace quickbook
     {
         bool found = fs::exists(fs::status(f));
         dependencies[f] |= found;
+        ++count_;
+        if (recording_) history_.push_back(std::make_pair(f, found));
         return found;
     }
 
+    std::size_t dependency_tracker::start_recording()
+    {
+        ++recording_;
+        return history_.size();
+    }
+
+    void dependency_tracker::stop_recording()
+    {
+        assert(recording_);
+        if (!--recording_) history_.clear();
+    }
+
     void dependency_tracker::add_glob(fs::path const& f)
     {
         std::pair<glob_list::iterator, bool> r = glob_dependencies.insert(
             std::make_pair(f, glob_list::mapped_type()));
         last_glob = r.first;
+        ++glob_count_;
     }
 
     void dependency_tracker::add_glob_match(fs::path const& f)
@@ -80,6 +100,16 @@ namespace quickbook
         last_glob->second.insert(f);
     }
 
+    void dependency_tracker::clear()
+    {
+        dependencies.clear();
+        glob_dependencies.clear();
+        last_glob = glob_dependencies.end();
+        history_.clear();
+        count_ = 0;
+        glob_count_ = 0;
+    }
+
     void dependency_tracker::write_dependencies(
         fs::path const& file_out, flags f)
     {
@@ -12,6 +12,7 @@
 #include <iosfwd>
 #include <map>
 #include <set>
+#include <vector>
 #include <boost/filesystem/path.hpp>
 
 namespace quickbook
@@ -27,6 +28,10 @@ namespace quickbook
         dependency_list dependencies;
         glob_list glob_dependencies;
         glob_list::iterator last_glob;
+        std::vector<std::pair<fs::path, bool> > history_;
+        unsigned recording_;
+        std::size_t count_;
+        std::size_t glob_count_;
 
       public:
         enum flags
@@ -45,6 +50,31 @@ namespace quickbook
         void add_glob(fs::path const&);
         void add_glob_match(fs::path const&);
 
+        // Forget all the dependencies that have been added.
+        void clear();
+
+        // Record the dependencies that are added, returns the index in the
+        // history of the first one that will be recorded. Recordings can be
+        // nested, the history is kept until the outermost recording stops.
+        std::size_t start_recording();
+        void stop_recording();
+
+        // Every dependency that's been added while recording, in order,
+        // with whether it was found. Used to find the dependencies of part
+        // of the document.
+        std::vector<std::pair<fs::path, bool> > const& history() const
+        {
+            return history_;
+        }
+
+        // The number of times a dependency has been added, whether or not
+        // it was recorded.
+        std::size_t count() const { return count_; }
+
+        // Globs aren't tracked in the history, this is just used to check
+        // if any have been used.
+        std::size_t glob_count() const { return glob_count_; }
+
         void write_dependencies(fs::path const&, flags = default_);
         void write_dependencies(std::ostream&, flags = default_);
     };
@@ -0,0 +1,276 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "diagnostics.hpp"
+#include <cassert>
+#include <cctype>
+#include <boost/functional/hash.hpp>
+#include <boost/lexical_cast.hpp>
+#include "for.hpp"
+#include "path.hpp"
+#include "utils.hpp"
+
+namespace quickbook
+{
+    namespace detail
+    {
+        namespace
+        {
+            std::string message_to_utf8(stream_string const& x)
+            {
+#if QUICKBOOK_WIDE_STREAMS
+                return to_utf8(x);
+#else
+                return x;
+#endif
+            }
+
+            void write_utf8(
+                diagnostic_sink::base_ostream& out, std::string const& x)
+            {
+#if QUICKBOOK_WIDE_STREAMS
+                out << from_utf8(x);
+#else
+                out << x;
+#endif
+            }
+
+            // Messages are usually written with a trailing newline, which
+            // isn't wanted in the json output.
+            std::string trim_message(stream_string const& x)
+            {
+                std::string result = message_to_utf8(x);
+                while (!result.empty() &&
+                       (result[result.size() - 1] == '\n' ||
+                        result[result.size() - 1] == '\r')) {
+                    result.erase(result.size() - 1);
+                }
+                return result;
+            }
+        }
+
+        const std::size_t diagnostic_sink::max_sites;
+
+        bool diagnostic_sink::key::operator==(key const& x) const
+        {
+            return type == x.type && line == x.line &&
+                   error_index == x.error_index && message == x.message &&
+                   file == x.file;
+        }
+
+        std::size_t diagnostic_sink::key::hash() const
+        {
+            std::size_t seed = 0;
+            boost::hash_combine(seed, static_cast<int>(type));
+            boost::hash_combine(seed, file.native());
+            boost::hash_combine(seed, line);
+            boost::hash_combine(seed, message);
+            boost::hash_combine(seed, error_index);
+            return seed;
+        }
+
+        diagnostic_sink::diagnostic_sink()
+            : output_format(text)
+            , max_diagnostics(0)
+            , ms_errors(false)
+            , diagnostics()
+            , order()
+            , written(0)
+            , not_written(0)
+        {
+        }
+
+        void diagnostic_sink::add(
+            severity type,
+            fs::path const& file,
+            std::ptrdiff_t line,
+            stream_string const& message,
+            site const& expanded_from)
+        {
+            key k;
+            k.type = type;
+            k.file = file;
+            k.line = line;
+            k.message = message;
+            k.error_index = type != warning ? order.size() + 1 : 0;
+
+            std::pair<diagnostic_map::iterator, bool> inserted =
+                diagnostics.emplace(k, occurrences());
+            if (inserted.second) order.push_back(&*inserted.first);
+
+            occurrences& x = inserted.first->second;
+            ++x.count;
+
+            if (!expanded_from.file.empty() && x.sites.size() < max_sites) {
+                QUICKBOOK_FOR (site const& s, x.sites) {
+                    if (s.line == expanded_from.line &&
+                        s.file == expanded_from.file)
+                        return;
+                }
+                x.sites.push_back(expanded_from);
+            }
+        }
+
+        void diagnostic_sink::write(base_ostream& out)
+        {
+            if (output_format != text) return;
+
+            write_text(out);
+            out.flush();
+            clear();
+        }
+
+        void diagnostic_sink::finish(base_ostream& out)
+        {
+            switch (output_format) {
+            case text:
+                write_text(out);
+                if (not_written) {
+                    write_location(out, fs::path(), -1, "note");
+                    out << not_written << " more diagnostics not shown\n";
+                }
+                break;
+            case json:
+                if (!order.empty()) write_json(out);
+                break;
+            default:
+                assert(false);
+            }
+
+            out.flush();
+            clear();
+            written = 0;
+            not_written = 0;
+        }
+
+        bool diagnostic_sink::count_diagnostic(severity type)
+        {
+            if (type == summary) return true;
+
+            if (max_diagnostics && written >= max_diagnostics) {
+                ++not_written;
+                return false;
+            }
+
+            ++written;
+            return true;
+        }
+
+        void diagnostic_sink::clear()
+        {
+            diagnostics.clear();
+            order.clear();
+        }
+
+        void diagnostic_sink::write_text(base_ostream& out)
+        {
+            QUICKBOOK_FOR (diagnostic_map::value_type const* x, order) {
+                if (!count_diagnostic(x->first.type)) continue;
+
+                key const& k = x->first;
+                occurrences const& o = x->second;
+
+                write_location(
+                    out, k.file, k.line,
+                    k.type == warning ? "warning" : "error");
+                out << k.message;
+
+                if (o.count > 1) {
+                    if (k.message.empty() ||
+                        k.message[k.message.size() - 1] != '\n') {
+                        out << '\n';
+                    }
+
+                    write_location(out, k.file, k.line, "note");
+                    out << "occurred " << o.count << " times\n";
+
+                    QUICKBOOK_FOR (site const& s, o.sites) {
+                        write_location(out, s.file, s.line, "note");
+                        out << "expanded from here\n";
+                    }
+                }
+            }
+        }
+
+        void diagnostic_sink::write_json(base_ostream& out)
+        {
+            std::string result = "{\n  \"diagnostics\": [";
+            char const* separator = "\n";
+
+            QUICKBOOK_FOR (diagnostic_map::value_type const* x, order) {
+                if (!count_diagnostic(x->first.type)) continue;
+
+                key const& k = x->first;
+                occurrences const& o = x->second;
+
+                result += separator;
+                result += "    {\"severity\": \"";
+                result += k.type == error
+                              ? "error"
+                              : k.type == warning ? "warning" : "summary";
+                result += "\"";
+                if (!k.file.empty()) {
+                    result += ", \"file\": \"";
+                    result += escape_json(path_to_generic(k.file));
+                    result += "\"";
+                }
+                if (k.line >= 0) {
+                    result += ", \"line\": ";
+                    result += boost::lexical_cast<std::string>(k.line);
+                }
+                result += ", \"message\": \"";
+                result += escape_json(trim_message(k.message));
+                result += "\", \"count\": ";
+                result += boost::lexical_cast<std::string>(o.count);
+                result += ", \"expanded_from\": [";
+                char const* site_separator = "";
+                QUICKBOOK_FOR (site const& s, o.sites) {
+                    result += site_separator;
+                    result += "{\"file\": \"";
+                    result += escape_json(path_to_generic(s.file));
+                    result += "\", \"line\": ";
+                    result += boost::lexical_cast<std::string>(s.line);
+                    result += "}";
+                    site_separator = ", ";
+                }
+                result += "]}";
+                separator = ",\n";
+            }
+
+            result += "\n  ],\n  \"not_shown\": ";
+            result += boost::lexical_cast<std::string>(not_written);
+            result += "\n}\n";
+
+            write_utf8(out, result);
+        }
+
+        void diagnostic_sink::write_location(
+            base_ostream& out,
+            fs::path const& file,
+            std::ptrdiff_t line,
+            char const* label)
+        {
+            if (file.empty()) {
+                // e.g. "Error: "
+                out << static_cast<char>(std::toupper(*label)) << (label + 1)
+                    << ": ";
+            }
+            else if (line < 0) {
+                out << path_to_stream(file) << ": " << label << ": ";
+            }
+            else if (ms_errors) {
+                out << path_to_stream(file) << "(" << line << "): " << label
+                    << ": ";
+            }
+            else {
+                out << path_to_stream(file) << ":" << line << ": " << label
+                    << ": ";
+            }
+        }
+    }
+}
@@ -0,0 +1,140 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(BOOST_QUICKBOOK_DIAGNOSTICS_HPP)
+#define BOOST_QUICKBOOK_DIAGNOSTICS_HPP
+
+#include <cstddef>
+#include <ostream>
+#include <vector>
+#include <boost/filesystem/path.hpp>
+#include <boost/unordered_map.hpp>
+#include "native_text.hpp"
+
+namespace quickbook
+{
+    namespace fs = boost::filesystem;
+
+    namespace detail
+    {
+        // Collects errors and warnings so that they can be written out
+        // together. Identical warnings - the same message at the same
+        // location, e.g. a warning in a template which is called many
+        // times - are only written once, with the number of times they
+        // occurred and the first few template calls they were expanded
+        // from. Errors are always written individually. 'max_diagnostics'
+        // applies to everything written between calls to 'finish', apart
+        // from summaries.
+
+        struct diagnostic_sink
+        {
+            typedef std::basic_ostream<stream_string::value_type> base_ostream;
+
+            // A summary is a message about the whole run, such as the
+            // number of errors. In text, it's written like an error
+            // without a location.
+            enum severity
+            {
+                error,
+                warning,
+                summary
+            };
+
+            enum format
+            {
+                text,
+                json
+            };
+
+            // Where a diagnostic was expanded from. 'line' is -1 if there
+            // isn't one.
+            struct site
+            {
+                fs::path file;
+                std::ptrdiff_t line;
+
+                site() : file(), line(-1) {}
+                site(fs::path const& f, std::ptrdiff_t l) : file(f), line(l)
+                {
+                }
+            };
+
+            // The number of expansion sites kept for each diagnostic.
+            static const std::size_t max_sites = 3;
+
+            format output_format;
+            unsigned max_diagnostics; // Zero for no limit.
+            bool ms_errors;
+
+            diagnostic_sink();
+
+            // 'file' is empty and 'line' is -1 when the diagnostic doesn't
+            // have them.
+            void add(
+                severity,
+                fs::path const& file,
+                std::ptrdiff_t line,
+                stream_string const& message,
+                site const& expanded_from = site());
+
+            bool empty() const { return order.empty(); }
+
+            // Write out the diagnostics collected so far, and then clear
+            // them. Only text is written this way, JSON is left until
+            // 'finish', so that it's a single object.
+            void write(base_ostream&);
+
+            // Write out any remaining diagnostics, and the number that
+            // weren't shown. Then clear them and reset the counts.
+            void finish(base_ostream&);
+
+          private:
+            struct key
+            {
+                severity type;
+                fs::path file;
+                std::ptrdiff_t line;
+                stream_string message;
+                // Errors and summaries are never merged, so each one has a
+                // different index. Zero for warnings.
+                std::size_t error_index;
+
+                bool operator==(key const&) const;
+                friend std::size_t hash_value(key const& x) { return x.hash(); }
+                std::size_t hash() const;
+            };
+
+            struct occurrences
+            {
+                unsigned count;
+                std::vector<site> sites;
+
+                occurrences() : count(0), sites() {}
+            };
+
+            typedef boost::unordered_map<key, occurrences> diagnostic_map;
+
+            diagnostic_map diagnostics;
+            std::vector<diagnostic_map::value_type const*> order;
+            std::size_t written;
+            std::size_t not_written;
+
+            // Counts a diagnostic as written or not written, returns true
+            // if it should be written. Summaries aren't counted.
+            bool count_diagnostic(severity);
+            void clear();
+
+            void write_text(base_ostream&);
+            void write_json(base_ostream&);
+            void write_location(
+                base_ostream&, fs::path const&, std::ptrdiff_t, char const*);
+        };
+    }
+}
+
+#endif
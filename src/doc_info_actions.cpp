@@ -368,6 +368,18 @@ namespace quickbook
         return write_boostbook_header(state, info, nested_file);
     }
 
+    std::string default_last_revision()
+    {
+        char strdate[64];
+        strftime(
+            strdate, sizeof(strdate),
+            (debug_mode ? "DEBUG MODE Date: %Y/%m/%d %H:%M:%S $"
+                        : "$" /* prevent CVS substitution */
+                          "Date: %Y/%m/%d %H:%M:%S $"),
+            current_gm_time);
+        return strdate;
+    }
+
     std::string write_boostbook_header(
         quickbook::state& state, doc_info_values const& info, bool nested_file)
     {
@@ -426,15 +438,8 @@ namespace quickbook
         else {
             // default value for last-revision is now
 
-            char strdate[64];
-            strftime(
-                strdate, sizeof(strdate),
-                (debug_mode ? "DEBUG MODE Date: %Y/%m/%d %H:%M:%S $"
-                            : "$" /* prevent CVS substitution */
-                              "Date: %Y/%m/%d %H:%M:%S $"),
-                current_gm_time);
-
-            state.out << strdate;
+            state.last_revisions.push_back(state.out.str().size());
+            state.out << default_last_revision();
         }
 
         state.out << "\" \n";
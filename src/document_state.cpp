@@ -6,110 +6,24 @@
     http://www.boost.org/LICENSE_1_0.txt)
 =============================================================================*/
 
+#include <algorithm>
+#include <cassert>
 #include <cctype>
 #include <boost/lexical_cast.hpp>
-#include <boost/make_shared.hpp>
 #include <boost/range/algorithm/count.hpp>
 #include "document_state_impl.hpp"
 #include "utils.hpp"
 
 namespace quickbook
 {
-    struct file_info
-    {
-        boost::shared_ptr<file_info> const parent;
-        boost::shared_ptr<doc_info> const document;
-
-        unsigned const compatibility_version;
-        unsigned const depth;
-        unsigned const override_depth;
-        id_placeholder const* const override_id;
-
-        // The 1.1-1.5 document id would actually change per file due to
-        // explicit ids in includes and a bug which would sometimes use the
-        // document title instead of the id.
-        std::string const doc_id_1_1;
-
-        // Constructor for files that aren't the root of a document.
-        explicit file_info(
-            boost::shared_ptr<file_info> const& parent_,
-            unsigned compatibility_version_,
-            quickbook::string_view doc_id_1_1_,
-            id_placeholder const* override_id_)
-            : parent(parent_)
-            , document(parent->document)
-            , compatibility_version(compatibility_version_)
-            , depth(parent->depth + 1)
-            , override_depth(override_id_ ? depth : parent->override_depth)
-            , override_id(override_id_ ? override_id_ : parent->override_id)
-            , doc_id_1_1(doc_id_1_1_.to_s())
-        {
-        }
-
-        // Constructor for files that are the root of a document.
-        explicit file_info(
-            boost::shared_ptr<file_info> const& parent_,
-            boost::shared_ptr<doc_info> const& document_,
-            unsigned compatibility_version_,
-            quickbook::string_view doc_id_1_1_)
-            : parent(parent_)
-            , document(document_)
-            , compatibility_version(compatibility_version_)
-            , depth(0)
-            , override_depth(0)
-            , override_id(0)
-            , doc_id_1_1(doc_id_1_1_.to_s())
-        {
-        }
-    };
-
-    struct doc_info
-    {
-        boost::shared_ptr<section_info> current_section;
-
-        // Note: these are mutable to remain bug compatible with old versions
-        // of quickbook. They would set these values at the start of new files
-        // and sections and then not restore them at the end.
-        std::string last_title_1_1;
-        std::string section_id_1_1;
-    };
-
-    struct section_info
-    {
-        boost::shared_ptr<section_info> const parent;
-        unsigned const compatibility_version;
-        unsigned const file_depth;
-        unsigned const level;
-
-        value const explicit_id;
-        std::string const id_1_1;
-        id_placeholder const* const placeholder_1_6;
-        source_mode_info const source_mode;
-
-        explicit section_info(
-            boost::shared_ptr<section_info> const& parent_,
-            file_info const* current_file_,
-            value const& explicit_id_,
-            quickbook::string_view id_1_1_,
-            id_placeholder const* placeholder_1_6_,
-            source_mode_info const& source_mode_)
-            : parent(parent_)
-            , compatibility_version(current_file_->compatibility_version)
-            , file_depth(current_file_->depth)
-            , level(parent ? parent->level + 1 : 1)
-            , explicit_id(explicit_id_)
-            , id_1_1(id_1_1_.to_s())
-            , placeholder_1_6(placeholder_1_6_)
-            , source_mode(source_mode_)
-        {
-        }
-    };
-
     //
     // document_state
     //
 
-    document_state::document_state() : state(new document_state_impl) {}
+    document_state::document_state()
+        : state(new document_state_impl), events(), recording(0)
+    {
+    }
 
     document_state::~document_state() {}
 
@@ -119,6 +33,15 @@ namespace quickbook
         quickbook::string_view id,
         value const& title_)
     {
+        if (recording) {
+            document_event e(document_event::start_file);
+            e.compatibility_version = compatibility_version_;
+            e.include_doc_id = include_doc_id.to_s();
+            e.id = id.to_s();
+            e.content = title_;
+            record(e);
+        }
+
         state->start_file(
             compatibility_version_, false, include_doc_id, id, title_);
     }
@@ -129,13 +52,26 @@ namespace quickbook
         quickbook::string_view id,
         value const& title_)
     {
+        if (recording) {
+            document_event e(document_event::start_file_with_docinfo);
+            e.compatibility_version = compatibility_version_;
+            e.include_doc_id = include_doc_id.to_s();
+            e.id = id.to_s();
+            e.content = title_;
+            record(e);
+        }
+
         return state
             ->start_file(
                 compatibility_version_, true, include_doc_id, id, title_)
             ->to_string();
     }
 
-    void document_state::end_file() { state->end_file(); }
+    void document_state::end_file()
+    {
+        if (recording) record(document_event(document_event::end_file));
+        state->end_file();
+    }
 
     std::string document_state::begin_section(
         value const& explicit_id_,
@@ -143,11 +79,24 @@ namespace quickbook
         id_category category,
         source_mode_info const& source_mode)
     {
+        if (recording) {
+            document_event e(document_event::begin_section);
+            e.content = explicit_id_;
+            e.id = id.to_s();
+            e.category = category;
+            e.source_mode = source_mode;
+            record(e);
+        }
+
         return state->begin_section(explicit_id_, id, category, source_mode)
             ->to_string();
     }
 
-    void document_state::end_section() { return state->end_section(); }
+    void document_state::end_section()
+    {
+        if (recording) record(document_event(document_event::end_section));
+        return state->end_section();
+    }
 
     int document_state::section_level() const
     {
@@ -169,18 +118,39 @@ namespace quickbook
     std::string document_state::old_style_id(
         quickbook::string_view id, id_category category)
     {
+        if (recording) {
+            document_event e(document_event::old_style_id);
+            e.id = id.to_s();
+            e.category = category;
+            record(e);
+        }
+
         return state->old_style_id(id, category)->to_string();
     }
 
     std::string document_state::add_id(
         quickbook::string_view id, id_category category)
     {
+        if (recording) {
+            document_event e(document_event::add_id);
+            e.id = id.to_s();
+            e.category = category;
+            record(e);
+        }
+
         return state->add_id(id, category)->to_string();
     }
 
     std::string document_state::add_anchor(
         quickbook::string_view id, id_category category)
     {
+        if (recording) {
+            document_event e(document_event::add_anchor);
+            e.id = id.to_s();
+            e.category = category;
+            record(e);
+        }
+
         return state->add_placeholder(id, category)->to_string();
     }
 
@@ -203,23 +173,92 @@ namespace quickbook
         return state->current_file->compatibility_version;
     }
 
+    std::size_t document_state::placeholder_count() const
+    {
+        return state->placeholders.size();
+    }
+
+    bool document_state::renumber_placeholders(
+        quickbook::string_view xml,
+        std::size_t first,
+        std::ptrdiff_t offset,
+        std::string& result) const
+    {
+        return quickbook::renumber_placeholders(xml, first, offset, result);
+    }
+
+    std::size_t document_state::start_recording()
+    {
+        ++recording;
+        return events.size();
+    }
+
+    void document_state::stop_recording()
+    {
+        assert(recording);
+        if (!--recording) events.clear();
+    }
+
+    std::vector<document_event> const& document_state::recorded_events() const
+    {
+        return events;
+    }
+
+    void document_state::record(document_event const& e)
+    {
+        events.push_back(e);
+    }
+
+    void document_state::replay(document_event const& e)
+    {
+        switch (e.type) {
+        case document_event::start_file:
+            start_file(
+                e.compatibility_version, e.include_doc_id, e.id, e.content);
+            break;
+        case document_event::start_file_with_docinfo:
+            start_file_with_docinfo(
+                e.compatibility_version, e.include_doc_id, e.id, e.content);
+            break;
+        case document_event::end_file:
+            end_file();
+            break;
+        case document_event::begin_section:
+            begin_section(e.content, e.id, e.category, e.source_mode);
+            break;
+        case document_event::end_section:
+            end_section();
+            break;
+        case document_event::old_style_id:
+            old_style_id(e.id, e.category);
+            break;
+        case document_event::add_id:
+            add_id(e.id, e.category);
+            break;
+        case document_event::add_anchor:
+            add_anchor(e.id, e.category);
+            break;
+        default:
+            assert(false);
+        }
+    }
+
     //
     // id_placeholder
     //
 
     id_placeholder::id_placeholder(
-        std::size_t index_,
+        unsigned index_,
         quickbook::string_view id_,
         id_category category_,
         id_placeholder const* parent_)
         : index(index_)
-        , id(id_.begin(), id_.end())
-        , unresolved_id(parent_ ? parent_->unresolved_id + '.' + id : id)
-        , parent(parent_)
         , category(category_)
         , num_dots(
-              boost::range::count(id, '.') +
+              static_cast<int>(boost::range::count(id_, '.')) +
               (parent_ ? parent_->num_dots + 1 : 0))
+        , id(id_)
+        , parent(parent_)
     {
     }
 
@@ -228,17 +267,42 @@ namespace quickbook
         return '$' + boost::lexical_cast<std::string>(index);
     }
 
+    void id_placeholder::append_unresolved_id(std::string& result) const
+    {
+        // Work out the size first, then fill in each segment from the end,
+        // so that the id is built in place.
+        std::size_t size = id.size();
+        for (id_placeholder const* p = parent; p; p = p->parent) {
+            size += p->id.size() + 1;
+        }
+
+        std::size_t pos = result.size() + size;
+        result.resize(pos);
+        for (id_placeholder const* p = this; p; p = p->parent) {
+            pos -= p->id.size();
+            std::copy(p->id.begin(), p->id.end(), result.begin() + pos);
+            if (p->parent) result[--pos] = '.';
+        }
+    }
+
     //
     // document_state_impl
     //
 
+    quickbook::string_view document_state_impl::intern(
+        quickbook::string_view id)
+    {
+        return *id_segments.insert(id.to_s()).first;
+    }
+
     id_placeholder const* document_state_impl::add_placeholder(
         quickbook::string_view id,
         id_category category,
         id_placeholder const* parent)
     {
-        placeholders.push_back(
-            id_placeholder(placeholders.size(), id, category, parent));
+        placeholders.push_back(id_placeholder(
+            static_cast<unsigned>(placeholders.size()), intern(id), category,
+            parent));
         return &placeholders.back();
     }
 
@@ -255,7 +319,7 @@ namespace quickbook
     }
 
     id_placeholder const* document_state_impl::get_id_placeholder(
-        boost::shared_ptr<section_info> const& section) const
+        section_info const* section) const
     {
         return !section ? 0
                         : section->file_depth < current_file->override_depth
@@ -270,11 +334,15 @@ namespace quickbook
         quickbook::string_view id,
         value const& title)
     {
-        boost::shared_ptr<file_info> parent = current_file;
+        file_info const* parent = current_file;
         assert(parent || document_root);
 
-        boost::shared_ptr<doc_info> document =
-            document_root ? boost::make_shared<doc_info>() : parent->document;
+        doc_info* document = parent ? parent->document : 0;
+
+        if (document_root) {
+            documents.push_back(doc_info());
+            document = &documents.back();
+        }
 
         // Choose specified id to use. Prefer 'include_doc_id' (the id
         // specified in an 'include' element) unless backwards compatibility
@@ -306,14 +374,15 @@ namespace quickbook
                     : detail::make_identifier(document->last_title_1_1);
         }
         else if (parent) {
-            doc_id_1_1 = parent->doc_id_1_1;
+            doc_id_1_1 = parent->doc_id_1_1.to_s();
         }
 
         if (document_root) {
             // Create new file
 
-            current_file = boost::make_shared<file_info>(
-                parent, document, compatibility_version, doc_id_1_1);
+            files.push_back(file_info(
+                parent, document, compatibility_version, intern(doc_id_1_1)));
+            current_file = &files.back();
 
             // Create a section for the new document.
 
@@ -354,17 +423,16 @@ namespace quickbook
             id_placeholder const* override_id = 0;
 
             if (!initial_doc_id.empty() && compatibility_version >= 106u) {
-                boost::shared_ptr<section_info> null_section;
-
                 override_id = add_id_to_section(
-                    initial_doc_id, id_category::explicit_section_id,
-                    null_section);
+                    initial_doc_id, id_category::explicit_section_id, 0);
             }
 
             // Create new file
 
-            current_file = boost::make_shared<file_info>(
-                parent, compatibility_version, doc_id_1_1, override_id);
+            files.push_back(file_info(
+                parent, compatibility_version, intern(doc_id_1_1),
+                override_id));
+            current_file = &files.back();
 
             return 0;
         }
@@ -385,7 +453,7 @@ namespace quickbook
     id_placeholder const* document_state_impl::add_id_to_section(
         quickbook::string_view id,
         id_category category,
-        boost::shared_ptr<section_info> const& section)
+        section_info const* section)
     {
         std::string id_part(id.begin(), id.end());
 
@@ -403,10 +471,10 @@ namespace quickbook
             return add_placeholder(id_part, category, placeholder_1_6);
         }
         else {
-            std::string const& qualified_id = section->id_1_1;
+            quickbook::string_view qualified_id = section->id_1_1;
 
             std::string new_id;
-            if (!placeholder_1_6) new_id = current_file->doc_id_1_1;
+            if (!placeholder_1_6) new_id = current_file->doc_id_1_1.to_s();
             if (!new_id.empty() && !qualified_id.empty()) new_id += '.';
             new_id += qualified_id;
             if (!new_id.empty() && !id_part.empty()) new_id += '.';
@@ -443,8 +511,7 @@ namespace quickbook
         id_category category,
         source_mode_info const& source_mode)
     {
-        boost::shared_ptr<section_info> parent =
-            current_file->document->current_section;
+        section_info const* parent = current_file->document->current_section;
 
         id_placeholder const* p = 0;
         id_placeholder const* placeholder_1_6 = 0;
@@ -452,7 +519,7 @@ namespace quickbook
         std::string id_1_1;
 
         if (parent && current_file->compatibility_version < 106u) {
-            id_1_1 = parent->id_1_1;
+            id_1_1 = parent->id_1_1.to_s();
             if (!id_1_1.empty() && !id.empty()) id_1_1 += ".";
             id_1_1.append(id.begin(), id.end());
         }
@@ -465,7 +532,7 @@ namespace quickbook
 
             std::string new_id;
             if (!placeholder_1_6) {
-                new_id = current_file->doc_id_1_1;
+                new_id = current_file->doc_id_1_1.to_s();
                 if (!id_1_1.empty()) new_id += '.';
             }
             new_id += id_1_1;
@@ -477,17 +544,17 @@ namespace quickbook
 
             std::string new_id;
             if (parent && !placeholder_1_6)
-                new_id = current_file->doc_id_1_1 + '.';
+                new_id = current_file->doc_id_1_1.to_s() + '.';
 
             new_id += id.to_s();
 
             p = add_placeholder(new_id, category, placeholder_1_6);
         }
 
-        current_file->document->current_section =
-            boost::make_shared<section_info>(
-                parent, current_file.get(), explicit_id, id_1_1,
-                placeholder_1_6, source_mode);
+        sections.push_back(section_info(
+            parent, current_file, explicit_id, intern(id_1_1), placeholder_1_6,
+            source_mode));
+        current_file->document->current_section = &sections.back();
 
         return p;
     }
@@ -10,6 +10,7 @@
 #define BOOST_QUICKBOOK_DOCUMENT_STATE_HPP
 
 #include <string>
+#include <vector>
 #include <boost/scoped_ptr.hpp>
 #include "string_view.hpp"
 #include "syntax_highlight.hpp"
@@ -45,6 +46,46 @@ namespace quickbook
         categories c;
     };
 
+    // document_event
+    //
+    // A call to one of the document_state methods which changes its state.
+    // These are recorded so that they can be replayed when the output for
+    // an included file is loaded from the cache.
+
+    struct document_event
+    {
+        enum event_type
+        {
+            start_file,
+            start_file_with_docinfo,
+            end_file,
+            begin_section,
+            end_section,
+            old_style_id,
+            add_id,
+            add_anchor
+        };
+
+        document_event(event_type type_)
+            : type(type_)
+            , compatibility_version(0)
+            , include_doc_id()
+            , id()
+            , content()
+            , category()
+            , source_mode()
+        {
+        }
+
+        event_type type;
+        unsigned compatibility_version;
+        std::string include_doc_id;
+        std::string id;
+        value content; // The title or explicit id.
+        id_category category;
+        source_mode_info source_mode;
+    };
+
     struct document_state_impl;
 
     struct document_state
@@ -86,8 +127,30 @@ namespace quickbook
 
         unsigned compatibility_version() const;
 
+        // Placeholders are numbered in the order they're created, so these
+        // are used to make the placeholders in cached output relative to
+        // the placeholders created for that output.
+        std::size_t placeholder_count() const;
+        bool renumber_placeholders(
+            quickbook::string_view xml,
+            std::size_t first,
+            std::ptrdiff_t offset,
+            std::string& result) const;
+
+        // Record events, returns the index of the first event that will be
+        // recorded. Recordings can be nested, events are kept until the
+        // outermost recording stops.
+        std::size_t start_recording();
+        void stop_recording();
+        std::vector<document_event> const& recorded_events() const;
+        void replay(document_event const&);
+
       private:
+        void record(document_event const&);
+
         boost::scoped_ptr<document_state_impl> state;
+        std::vector<document_event> events;
+        unsigned recording;
     };
 }
 
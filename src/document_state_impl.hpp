@@ -12,7 +12,7 @@
 #include <deque>
 #include <string>
 #include <vector>
-#include <boost/shared_ptr.hpp>
+#include <boost/unordered_set.hpp>
 #include "document_state.hpp"
 #include "phrase_tags.hpp"
 #include "string_view.hpp"
@@ -30,46 +30,157 @@ namespace quickbook
 
     struct id_placeholder
     {
-        std::size_t index; // The index in document_state_impl::placeholders.
-                           // Use for the dollar identifiers in
-                           // intermediate xml.
-        std::string id;    // The node id.
-        std::string unresolved_id;
-        // The id that would be generated
-        // without any duplicate handling.
-        // Used for generating old style header anchors.
+        unsigned index; // The index in document_state_impl::placeholders.
+                        // Use for the dollar identifiers in
+                        // intermediate xml.
+        id_category category;
+        int num_dots; // Number of dots in the id.
+                      // Normally equal to the section level
+                      // but not when an explicit id contains
+                      // dots.
+        quickbook::string_view id;
+        // The node id, relative to the parent. Interned in
+        // document_state_impl::id_segments, so that placeholders
+        // only store their own part of the id.
         id_placeholder const* parent;
         // Placeholder of the parent id.
-        id_category category;
-        std::ptrdiff_t num_dots; // Number of dots in the id.
-                                 // Normally equal to the section level
-                                 // but not when an explicit id contains
-                                 // dots.
 
         id_placeholder(
-            std::size_t index,
+            unsigned index,
             quickbook::string_view id,
             id_category category,
             id_placeholder const* parent_);
 
         std::string to_string() const;
+
+        // Append the id that would be generated without any duplicate
+        // handling. Used for generating old style header anchors.
+        void append_unresolved_id(std::string&) const;
     };
 
     //
-    // document_state_impl
+    // file_info, doc_info, section_info
     //
-    // Contains all the data tracked by document_state.
+    // The state for the current file, document and section. These are
+    // allocated in document_state_impl, and are kept until it's destroyed,
+    // so they can just point to their parents.
     //
 
-    struct file_info;
     struct doc_info;
     struct section_info;
 
+    struct file_info
+    {
+        file_info const* const parent;
+        doc_info* const document;
+
+        unsigned const compatibility_version;
+        unsigned const depth;
+        unsigned const override_depth;
+        id_placeholder const* const override_id;
+
+        // The 1.1-1.5 document id would actually change per file due to
+        // explicit ids in includes and a bug which would sometimes use the
+        // document title instead of the id.
+        quickbook::string_view const doc_id_1_1;
+
+        // Constructor for files that aren't the root of a document.
+        explicit file_info(
+            file_info const* parent_,
+            unsigned compatibility_version_,
+            quickbook::string_view doc_id_1_1_,
+            id_placeholder const* override_id_)
+            : parent(parent_)
+            , document(parent->document)
+            , compatibility_version(compatibility_version_)
+            , depth(parent->depth + 1)
+            , override_depth(override_id_ ? depth : parent->override_depth)
+            , override_id(override_id_ ? override_id_ : parent->override_id)
+            , doc_id_1_1(doc_id_1_1_)
+        {
+        }
+
+        // Constructor for files that are the root of a document.
+        explicit file_info(
+            file_info const* parent_,
+            doc_info* document_,
+            unsigned compatibility_version_,
+            quickbook::string_view doc_id_1_1_)
+            : parent(parent_)
+            , document(document_)
+            , compatibility_version(compatibility_version_)
+            , depth(0)
+            , override_depth(0)
+            , override_id(0)
+            , doc_id_1_1(doc_id_1_1_)
+        {
+        }
+    };
+
+    struct doc_info
+    {
+        section_info const* current_section;
+
+        // Note: these are mutable to remain bug compatible with old versions
+        // of quickbook. They would set these values at the start of new files
+        // and sections and then not restore them at the end.
+        std::string last_title_1_1;
+        std::string section_id_1_1;
+
+        doc_info() : current_section(0) {}
+    };
+
+    struct section_info
+    {
+        section_info const* const parent;
+        unsigned const compatibility_version;
+        unsigned const file_depth;
+        unsigned const level;
+
+        value const explicit_id;
+        quickbook::string_view const id_1_1;
+        id_placeholder const* const placeholder_1_6;
+        source_mode_info const source_mode;
+
+        explicit section_info(
+            section_info const* parent_,
+            file_info const* current_file_,
+            value const& explicit_id_,
+            quickbook::string_view id_1_1_,
+            id_placeholder const* placeholder_1_6_,
+            source_mode_info const& source_mode_)
+            : parent(parent_)
+            , compatibility_version(current_file_->compatibility_version)
+            , file_depth(current_file_->depth)
+            , level(parent ? parent->level + 1 : 1)
+            , explicit_id(explicit_id_)
+            , id_1_1(id_1_1_)
+            , placeholder_1_6(placeholder_1_6_)
+            , source_mode(source_mode_)
+        {
+        }
+    };
+
+    //
+    // document_state_impl
+    //
+    // Contains all the data tracked by document_state.
+    //
+
     struct document_state_impl
     {
-        boost::shared_ptr<file_info> current_file;
+        file_info const* current_file;
         std::deque<id_placeholder> placeholders;
 
+        // Storage for the above. Deques, so that pointers to the elements
+        // remain valid as they grow.
+        boost::unordered_set<std::string> id_segments;
+        std::deque<file_info> files;
+        std::deque<doc_info> documents;
+        std::deque<section_info> sections;
+
+        document_state_impl() : current_file(0) {}
+
         // Placeholder methods
 
         id_placeholder const* add_placeholder(
@@ -80,7 +191,7 @@ namespace quickbook
         id_placeholder const* get_placeholder(quickbook::string_view) const;
 
         id_placeholder const* get_id_placeholder(
-            boost::shared_ptr<section_info> const& section) const;
+            section_info const* section) const;
 
         // Events
 
@@ -105,10 +216,11 @@ namespace quickbook
         void end_section();
 
       private:
+        quickbook::string_view intern(quickbook::string_view);
         id_placeholder const* add_id_to_section(
             quickbook::string_view id,
             id_category category,
-            boost::shared_ptr<section_info> const& section);
+            section_info const* section);
         id_placeholder const* create_new_section(
             value const& explicit_id,
             quickbook::string_view id,
@@ -122,6 +234,11 @@ namespace quickbook
         std::vector<std::string> const* = 0);
     std::vector<std::string> generate_ids(
         document_state_impl const&, quickbook::string_view);
+    bool renumber_placeholders(
+        quickbook::string_view xml,
+        std::size_t first,
+        std::ptrdiff_t offset,
+        std::string& result);
 
     std::string normalize_id(quickbook::string_view src_id);
     std::string normalize_id(quickbook::string_view src_id, std::size_t);
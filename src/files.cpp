@@ -8,11 +8,13 @@
     http://www.boost.org/LICENSE_1_0.txt)
 =============================================================================*/
 #include "files.hpp"
+#include <ctime>
 #include <fstream>
 #include <iterator>
 #include <vector>
 #include <list>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
 #include <boost/range/algorithm/transform.hpp>
 #include <boost/range/algorithm/upper_bound.hpp>
 #include <boost/unordered_map.hpp>
@@ -107,25 +109,89 @@ namespace quickbook
         }
     }
 
-    file_ptr load(fs::path const& filename, unsigned qbk_version)
+    static void read_file(fs::path const& filename, std::string& source)
     {
-        boost::unordered_map<fs::path, file_ptr>::iterator pos =
-            files.find(filename);
+        fs::ifstream in(filename, std::ios_base::in);
 
-        if (pos == files.end()) {
-            fs::ifstream in(filename, std::ios_base::in);
+        if (!in) throw load_error("Could not open input file.");
+
+        // Turn off white space skipping on the stream
+        in.unsetf(std::ios::skipws);
 
-            if (!in) throw load_error("Could not open input file.");
+        normalize(
+            std::istream_iterator<char>(in), std::istream_iterator<char>(),
+            std::back_inserter(source));
 
-            // Turn off white space skipping on the stream
-            in.unsetf(std::ios::skipws);
+        if (in.bad()) throw load_error("Error reading input file.");
+    }
 
+    // Cached sources.
+    //
+    // Files which are read before parsing starts, so that they can be shared
+    // by the documents that the server parses. They're keyed on the
+    // canonical path, as the working directory changes between documents,
+    // and are only used if the file's size and modification time haven't
+    // changed since it was read.
+
+    namespace
+    {
+        struct cached_source
+        {
+            std::time_t last_write_time;
+            boost::uintmax_t size;
             std::string source;
-            normalize(
-                std::istream_iterator<char>(in), std::istream_iterator<char>(),
-                std::back_inserter(source));
+        };
 
-            if (in.bad()) throw load_error("Error reading input file.");
+        boost::unordered_map<fs::path, cached_source> cached_sources;
+
+        bool take_cached_source(fs::path const& filename, std::string& source)
+        {
+            if (cached_sources.empty()) return false;
+
+            boost::system::error_code ec;
+            fs::path path = fs::canonical(filename, ec);
+            if (ec) return false;
+
+            auto pos = cached_sources.find(path);
+            if (pos == cached_sources.end()) return false;
+
+            std::time_t last_write_time = fs::last_write_time(path, ec);
+            if (ec || last_write_time != pos->second.last_write_time)
+                return false;
+            boost::uintmax_t size = fs::file_size(path, ec);
+            if (ec || size != pos->second.size) return false;
+
+            source.swap(pos->second.source);
+            cached_sources.erase(pos);
+            return true;
+        }
+    }
+
+    void cache_source(fs::path const& filename)
+    {
+        boost::system::error_code ec;
+        fs::path path = fs::canonical(filename, ec);
+        if (ec) throw load_error("Could not open input file.");
+
+        cached_source entry;
+        entry.last_write_time = fs::last_write_time(path, ec);
+        if (!ec) entry.size = fs::file_size(path, ec);
+        if (ec) throw load_error("Could not open input file.");
+        read_file(path, entry.source);
+
+        cached_sources[path] = std::move(entry);
+    }
+
+    file_ptr load(fs::path const& filename, unsigned qbk_version)
+    {
+        boost::unordered_map<fs::path, file_ptr>::iterator pos =
+            files.find(filename);
+
+        if (pos == files.end()) {
+            std::string source;
+            if (!take_cached_source(filename, source)) {
+                read_file(filename, source);
+            }
 
             bool inserted;
 
@@ -176,7 +242,34 @@ namespace quickbook
 
     file_position file::position_of(string_iterator iterator) const
     {
-        return relative_position(source().begin(), iterator);
+        // Sources are normalized when loaded, so usually don't contain
+        // '\r'. If one does, fall back to 'relative_position' as it
+        // has its own rules for dealing with them.
+        if (indexed_size_ != source_.size()) {
+            indexed_size_ = source_.size();
+            line_starts_.clear();
+            line_starts_.push_back(0);
+            for (std::string::size_type i = 0; i < source_.size(); ++i) {
+                if (source_[i] == '\r') {
+                    line_starts_.clear();
+                    break;
+                }
+                else if (source_[i] == '\n') {
+                    line_starts_.push_back(i + 1);
+                }
+            }
+        }
+
+        if (line_starts_.empty()) {
+            return relative_position(source().begin(), iterator);
+        }
+
+        std::string::size_type offset = iterator - source().begin();
+        std::vector<std::string::size_type>::const_iterator line =
+            boost::upper_bound(line_starts_, offset);
+
+        return file_position(
+            line - line_starts_.begin(), offset - *(line - 1) + 1);
     }
 
     // Mapped files.
@@ -589,7 +682,7 @@ namespace quickbook
 
         unindented_program.append(program.begin() + copy_start, program.end());
 
-        data->new_file->add_indented_mapped_file_section(x.begin());
+        data->new_file->add_indented_mapped_file_section(x.begin() + text_start);
         data->new_file->source_.append(unindented_program);
     }
 
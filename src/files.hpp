@@ -15,6 +15,7 @@
 #include <iosfwd>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <boost/filesystem/path.hpp>
 #include <boost/intrusive_ptr.hpp>
 #include "string_view.hpp"
@@ -64,6 +65,11 @@ namespace quickbook
         unsigned qbk_version;
         unsigned ref_count;
 
+        // Offsets of the start of each line, built on demand by
+        // position_of. Empty if the source contains a '\r'.
+        mutable std::vector<std::string::size_type> line_starts_;
+        mutable std::string::size_type indexed_size_;
+
       public:
         quickbook::string_view source() const { return source_; }
 
@@ -76,6 +82,8 @@ namespace quickbook
             , is_code_snippets(false)
             , qbk_version(qbk_version_)
             , ref_count(0)
+            , line_starts_()
+            , indexed_size_(std::string::npos)
         {
         }
 
@@ -85,6 +93,8 @@ namespace quickbook
             , is_code_snippets(f.is_code_snippets)
             , qbk_version(f.qbk_version)
             , ref_count(0)
+            , line_starts_()
+            , indexed_size_(std::string::npos)
         {
         }
 
@@ -118,6 +128,11 @@ namespace quickbook
     // If version isn't supplied then it must be set later.
     file_ptr load(fs::path const& filename, unsigned qbk_version = 0);
 
+    // Read a file before any documents are parsed, so that the server can
+    // share it between them. It's read again when it's loaded if it's
+    // changed since. Throws load_error.
+    void cache_source(fs::path const& filename);
+
     struct load_error : std::runtime_error
     {
         explicit load_error(std::string const& arg) : std::runtime_error(arg) {}
@@ -0,0 +1,100 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(QUICKBOOK_FINGERPRINT_HPP)
+#define QUICKBOOK_FINGERPRINT_HPP
+
+#include <string>
+#include <boost/cstdint.hpp>
+#include "string_view.hpp"
+
+namespace quickbook
+{
+    // A 64 bit FNV-1a hash, used to detect when cached data is out of date.
+    //
+    // This isn't a cryptographic hash, it's only meant to catch accidental
+    // changes. Strings are prefixed with their length, so that the
+    // boundaries between the values that are added are significant.
+
+    struct fingerprint
+    {
+        typedef boost::uint64_t value_type;
+
+        fingerprint() : value_(offset_basis) {}
+        explicit fingerprint(value_type x) : value_(x) {}
+
+        fingerprint& add(quickbook::string_view x)
+        {
+            add(static_cast<value_type>(x.size()));
+            add_bytes(x.data(), x.size());
+            return *this;
+        }
+
+        fingerprint& add(char const* x)
+        {
+            return add(quickbook::string_view(x));
+        }
+
+        fingerprint& add(std::string const& x)
+        {
+            return add(quickbook::string_view(x));
+        }
+
+        fingerprint& add(value_type x)
+        {
+            for (int i = 0; i < 8; ++i) {
+                add_byte(static_cast<unsigned char>(x >> (i * 8)));
+            }
+            return *this;
+        }
+
+        value_type value() const { return value_; }
+
+        // 16 lower case hex digits.
+        std::string hex() const
+        {
+            static char const digits[] = "0123456789abcdef";
+            std::string result(16, '0');
+            for (int i = 0; i < 16; ++i) {
+                result[15 - i] = digits[(value_ >> (i * 4)) & 0xf];
+            }
+            return result;
+        }
+
+        bool operator==(fingerprint const& x) const
+        {
+            return value_ == x.value_;
+        }
+
+        bool operator!=(fingerprint const& x) const
+        {
+            return value_ != x.value_;
+        }
+
+      private:
+        static value_type const offset_basis = 0xcbf29ce484222325ull;
+        static value_type const prime = 0x100000001b3ull;
+
+        void add_byte(unsigned char c)
+        {
+            value_ ^= c;
+            value_ *= prime;
+        }
+
+        void add_bytes(char const* x, std::size_t n)
+        {
+            for (std::size_t i = 0; i < n; ++i) {
+                add_byte(static_cast<unsigned char>(x[i]));
+            }
+        }
+
+        value_type value_;
+    };
+}
+
+#endif
@@ -187,8 +187,12 @@ namespace quickbook
 
     std::string generate_id_block_type::resolve_id(id_placeholder const* p)
     {
-        std::string id =
-            p->parent ? generated_ids[p->parent->index] + "." + p->id : p->id;
+        std::string id;
+        if (p->parent) {
+            id = generated_ids[p->parent->index];
+            id += '.';
+        }
+        id += p->id;
 
         if (p->category.c > id_category::numbered) {
             // Reserve the id if it isn't already reserved.
@@ -244,6 +248,7 @@ namespace quickbook
         }
 
         unsigned count = 0;
+        std::string generated_id;
 
         for (;;) {
             std::string postfix = boost::lexical_cast<std::string>(count++);
@@ -267,7 +272,7 @@ namespace quickbook
             }
             else {
                 // Try to reserve this id.
-                std::string generated_id = parent_id + base_id + postfix;
+                generated_id.assign(parent_id).append(base_id).append(postfix);
 
                 if (chosen_ids.emplace(generated_id, p).second) {
                     return generated_id;
@@ -302,11 +307,11 @@ namespace quickbook
         void id_value(quickbook::string_view value)
         {
             if (id_placeholder const* p = state.get_placeholder(value)) {
-                quickbook::string_view id =
-                    ids ? (*ids)[p->index] : p->unresolved_id;
-
                 result.append(source_pos, value.begin());
-                result.append(id.begin(), id.end());
+                if (ids)
+                    result += (*ids)[p->index];
+                else
+                    p->append_unresolved_id(result);
                 source_pos = value.end();
             }
         }
@@ -329,6 +334,75 @@ namespace quickbook
         return callback.result;
     }
 
+    //
+    // renumber_placeholders
+    //
+    // Adds 'offset' to the placeholders in some xml. Fails if the xml
+    // contains a placeholder from before 'first'.
+    //
+
+    struct renumber_placeholders_callback : xml_processor::callback
+    {
+        std::size_t first;
+        std::ptrdiff_t offset;
+        bool valid;
+        string_iterator source_pos;
+        std::string& result;
+
+        renumber_placeholders_callback(
+            std::size_t first_, std::ptrdiff_t offset_, std::string& result_)
+            : first(first_)
+            , offset(offset_)
+            , valid(true)
+            , source_pos()
+            , result(result_)
+        {
+        }
+
+        void start(quickbook::string_view xml) { source_pos = xml.begin(); }
+
+        void id_value(quickbook::string_view value)
+        {
+            if (value.size() <= 1 || *value.begin() != '$') return;
+
+            std::size_t index = 0;
+            for (string_iterator it = value.begin() + 1; it != value.end();
+                 ++it) {
+                if (*it < '0' || *it > '9') return;
+                index = index * 10 + (*it - '0');
+            }
+
+            if (index < first) {
+                valid = false;
+                return;
+            }
+
+            result.append(source_pos, value.begin());
+            result += '$';
+            result += boost::lexical_cast<std::string>(
+                static_cast<std::ptrdiff_t>(index) + offset);
+            source_pos = value.end();
+        }
+
+        void finish(quickbook::string_view xml)
+        {
+            result.append(source_pos, xml.end());
+            source_pos = xml.end();
+        }
+    };
+
+    bool renumber_placeholders(
+        quickbook::string_view xml,
+        std::size_t first,
+        std::ptrdiff_t offset,
+        std::string& result)
+    {
+        xml_processor processor;
+        renumber_placeholders_callback callback(first, offset, result);
+        processor.parse(xml, callback);
+        return callback.valid;
+    }
+
     //
     // normalize_id
     //
@@ -0,0 +1,627 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "include_cache.hpp"
+#include <cassert>
+#include <iterator>
+#include <map>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp>
+#include "actions.hpp"
+#include "block_tags.hpp"
+#include "document_state.hpp"
+#include "files.hpp"
+#include "for.hpp"
+#include "path.hpp"
+#include "quickbook.hpp"
+#include "state.hpp"
+#include "stream.hpp"
+
+namespace quickbook
+{
+    namespace
+    {
+        // Change this whenever the format of the cache files changes.
+        char const* const cache_format = "quickbook include cache 2";
+
+        // Nested documents without a last revision use the time the
+        // document was built. That's replaced with this in the cache, so
+        // that the current time can be written when it's replayed.
+        char const revision_marker = '\0';
+
+        ////////////////////////////////////////////////////////////////////
+        // Cache files are a sequence of numbers and strings. Numbers are
+        // followed by a newline, strings are prefixed with their length.
+
+        void write_number(std::ostream& out, boost::uint64_t x)
+        {
+            out << x << '\n';
+        }
+
+        void write_string(std::ostream& out, quickbook::string_view x)
+        {
+            write_number(out, x.size());
+            out.write(x.data(), static_cast<std::streamsize>(x.size()));
+            out << '\n';
+        }
+
+        template <typename T> bool read_number(std::istream& in, T& x)
+        {
+            boost::uint64_t n;
+            if (!(in >> n) || in.get() != '\n') return false;
+            x = static_cast<T>(n);
+            return static_cast<boost::uint64_t>(x) == n;
+        }
+
+        bool read_string(std::istream& in, std::string& x)
+        {
+            std::size_t size;
+            if (!read_number(in, size)) return false;
+            x.resize(size);
+            if (size && !in.read(&x[0], static_cast<std::streamsize>(size)))
+                return false;
+            return in.get() == '\n';
+        }
+
+        ////////////////////////////////////////////////////////////////////
+        // Fingerprints of the things an included file depends on.
+
+        fingerprint template_fingerprint(template_symbol const& t)
+        {
+            fingerprint result;
+            result.add(t.identifier);
+            result.add(t.params.size());
+            QUICKBOOK_FOR (std::string const& p, t.params) {
+                result.add(p);
+            }
+            result.add(static_cast<fingerprint::value_type>(
+                t.content.get_tag()));
+
+            // Encoded templates are written out as is, otherwise the
+            // template is parsed according to its file's version.
+            if (t.content.is_encoded()) {
+                result.add(t.content.get_encoded());
+            }
+            else {
+                file_ptr f = t.content.get_file();
+                result.add(t.content.get_quickbook());
+                result.add(detail::path_to_generic(f->path));
+                result.add(f->version());
+            }
+
+            return result;
+        }
+
+        // Anything that isn't a regular file just has its existence checked.
+        bool file_fingerprint(fs::path const& path, fingerprint& result)
+        {
+            result = fingerprint();
+            if (!fs::is_regular_file(path)) return true;
+
+            fs::ifstream in(path, std::ios_base::binary);
+            if (!in) return false;
+            std::string contents(
+                (std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+            if (in.bad()) return false;
+            result.add(contents);
+            return true;
+        }
+
+        ////////////////////////////////////////////////////////////////////
+        // Document events
+
+        // Values in events are either empty, or part of the included file.
+        bool write_value(std::ostream& out, value const& x, file_ptr const& f)
+        {
+            if (!x.check()) {
+                write_number(out, 0);
+                return true;
+            }
+
+            try {
+                if (x.get_file() != f) return false;
+                quickbook::string_view source = f->source();
+                quickbook::string_view qbk = x.get_quickbook();
+                if (qbk.begin() < source.begin() || qbk.end() > source.end())
+                    return false;
+
+                write_number(out, 1);
+                write_number(out, x.get_tag());
+                write_number(out, qbk.begin() - source.begin());
+                write_number(out, qbk.size());
+                return true;
+            } catch (value_error&) {
+                return false;
+            }
+        }
+
+        bool read_value(std::istream& in, value& x, file_ptr const& f)
+        {
+            int type;
+            if (!read_number(in, type)) return false;
+            if (type == 0) {
+                x = value();
+                return true;
+            }
+
+            value::tag_type tag;
+            std::size_t begin, size;
+            if (type != 1 || !read_number(in, tag) ||
+                !read_number(in, begin) || !read_number(in, size) ||
+                begin + size > f->source().size())
+                return false;
+
+            string_iterator first = f->source().begin() + begin;
+            x = qbk_value(f, first, first + size, tag);
+            return true;
+        }
+
+        bool write_event(
+            std::ostream& out,
+            document_event const& e,
+            file_ptr const& f,
+            unsigned order_start)
+        {
+            write_number(out, e.type);
+
+            switch (e.type) {
+            case document_event::start_file:
+            case document_event::start_file_with_docinfo:
+                write_number(out, e.compatibility_version);
+                write_string(out, e.include_doc_id);
+                write_string(out, e.id);
+                return write_value(out, e.content, f);
+            case document_event::begin_section:
+                // Source modes are only used while parsing the section, so
+                // their order just needs to be consistent with the rest of
+                // the file.
+                write_string(out, e.id);
+                write_number(out, e.category.c);
+                write_number(out, e.source_mode.source_mode);
+                write_number(
+                    out, e.source_mode.order > order_start
+                             ? e.source_mode.order - order_start
+                             : 0);
+                return write_value(out, e.content, f);
+            case document_event::old_style_id:
+            case document_event::add_id:
+            case document_event::add_anchor:
+                write_string(out, e.id);
+                write_number(out, e.category.c);
+                return true;
+            default:
+                return true;
+            }
+        }
+
+        bool read_event(
+            std::istream& in,
+            document_event& e,
+            file_ptr const& f,
+            unsigned order_start)
+        {
+            int type, category;
+            unsigned order;
+
+            if (!read_number(in, type) || type < document_event::start_file ||
+                type > document_event::add_anchor)
+                return false;
+            e = document_event(document_event::event_type(type));
+
+            switch (e.type) {
+            case document_event::start_file:
+            case document_event::start_file_with_docinfo:
+                return read_number(in, e.compatibility_version) &&
+                       read_string(in, e.include_doc_id) &&
+                       read_string(in, e.id) && read_value(in, e.content, f);
+            case document_event::begin_section:
+                if (!read_string(in, e.id) || !read_number(in, category) ||
+                    !read_number(in, e.source_mode.source_mode) ||
+                    !read_number(in, order))
+                    return false;
+                e.category = id_category(category);
+                e.source_mode.order = order ? order_start + order : 0;
+                return read_value(in, e.content, f);
+            case document_event::old_style_id:
+            case document_event::add_id:
+            case document_event::add_anchor:
+                if (!read_string(in, e.id) || !read_number(in, category))
+                    return false;
+                e.category = id_category(category);
+                return true;
+            default:
+                return true;
+            }
+        }
+
+        // Check that the file was started and finished, and that any
+        // sections it started were ended. Sections in nested documents are
+        // separate from the current document's.
+        //
+        // Before 1.6, ids were generated using state from the containing
+        // document and written to the output unresolved, so that's only
+        // allowed in nested documents, which don't have that dependency.
+        bool check_events(
+            std::vector<document_event>::const_iterator it,
+            std::vector<document_event>::const_iterator end)
+        {
+            std::vector<bool> doc_info_files;
+            std::vector<int> section_levels(1, 0);
+
+            for (; it != end; ++it) {
+                switch (it->type) {
+                case document_event::start_file:
+                case document_event::start_file_with_docinfo:
+                    if (it->type == document_event::start_file &&
+                        it->compatibility_version < 106u &&
+                        section_levels.size() == 1)
+                        return false;
+                    doc_info_files.push_back(
+                        it->type == document_event::start_file_with_docinfo);
+                    if (doc_info_files.back()) section_levels.push_back(0);
+                    break;
+                case document_event::end_file:
+                    if (doc_info_files.empty()) return false;
+                    if (doc_info_files.back()) section_levels.pop_back();
+                    doc_info_files.pop_back();
+                    break;
+                case document_event::begin_section:
+                    ++section_levels.back();
+                    break;
+                case document_event::end_section:
+                    if (--section_levels.back() < 0 &&
+                        section_levels.size() == 1)
+                        return false;
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            return doc_info_files.empty() && section_levels.size() == 1 &&
+                   section_levels.back() == 0;
+        }
+    }
+
+    cached_include::cached_include(
+        quickbook::state& state_,
+        quickbook_path const& path,
+        value::tag_type load_type,
+        value const& include_doc_id)
+        : state(state_)
+        , recording(false)
+        , replayed_(false)
+        , file()
+        , cache_path()
+        , output_start(0)
+        , placeholder_start(0)
+        , event_start(0)
+        , dependency_start(0)
+        , last_revision_start(0)
+        , diagnostic_start(0)
+        , error_start(0)
+        , time_dependent_start(0)
+        , glob_start(0)
+        , order_start(0)
+        , explicit_list(false)
+        , in_list(false)
+        , source_mode_next(0)
+        , templates()
+    {
+        // Older versions don't scope included files, and imports change the
+        // current scope, so only cache includes in quickbook 1.6+. Files
+        // aren't parsed after an error. Anchors and phrases that haven't
+        // been written yet would end up in the included file's output.
+        if (state.include_cache_dir.empty() || state.error_count ||
+            load_type != block_tags::include || qbk_version_n < 106u ||
+            !state.anchors.empty() || !state.phrase.str().empty() ||
+            state.callout_depth) {
+            return;
+        }
+
+        file = load(path.file_path); // Throws load_error
+
+        fingerprint key;
+        key.add(cache_format)
+            .add(QUICKBOOK_VERSION)
+            .add(detail::path_to_generic(path.file_path))
+            .add(detail::path_to_generic(path.abstract_file_path))
+            .add(file->source())
+            .add(include_doc_id.empty() ? quickbook::string_view()
+                                        : include_doc_id.get_quickbook())
+            .add(qbk_version_n)
+            .add(state.document.compatibility_version())
+            .add(state.document.section_level())
+            .add(state.min_section_level)
+            .add(state.template_depth)
+            .add(state.current_source_mode().source_mode)
+            .add(state.source_mode_next)
+            .add(state.in_list)
+            .add(state.explicit_list)
+            .add(state.strict_mode)
+            .add(detail::path_to_generic(state.xinclude_base))
+            .add(state.macro_fingerprint.value())
+            .add(state.templates.visible_names().value())
+            .add(self_linked_headers)
+            .add(detail::path_to_generic(image_location))
+            .add(include_path.size());
+        QUICKBOOK_FOR (fs::path const& p, include_path) {
+            key.add(detail::path_to_generic(p));
+        }
+
+        cache_path = state.include_cache_dir / (key.hex() + ".qbkcache");
+
+        if (replay()) {
+            replayed_ = true;
+            return;
+        }
+
+        output_start = state.out.str().size();
+        placeholder_start = state.document.placeholder_count();
+        event_start = state.document.start_recording();
+        dependency_start = state.dependencies.start_recording();
+        last_revision_start = state.last_revisions.size();
+        diagnostic_start = detail::diagnostic_count();
+        error_start = state.error_count;
+        time_dependent_start = state.time_dependent_output;
+        glob_start = state.dependencies.glob_count();
+        order_start = state.order_pos;
+        explicit_list = state.explicit_list;
+        in_list = state.in_list;
+        source_mode_next = state.source_mode_next;
+        templates = state.templates.start_recording();
+        recording = true;
+    }
+
+    cached_include::~cached_include() { stop_recording(); }
+
+    void cached_include::stop_recording()
+    {
+        if (recording) {
+            state.templates.stop_recording(templates);
+            state.dependencies.stop_recording();
+            state.document.stop_recording();
+            recording = false;
+        }
+    }
+
+    bool cached_include::replay()
+    {
+        try {
+            fs::ifstream in(cache_path, std::ios_base::binary);
+            if (!in) return false;
+
+            std::string format;
+            if (!read_string(in, format) || format != cache_format)
+                return false;
+
+            // Check the inherited templates that were used.
+            std::size_t count;
+            if (!read_number(in, count)) return false;
+            for (std::size_t i = 0; i < count; ++i) {
+                std::string identifier;
+                fingerprint::value_type fp;
+                if (!read_string(in, identifier) || !read_number(in, fp))
+                    return false;
+                template_symbol const* t = state.templates.find(identifier);
+                if (!t || template_fingerprint(*t).value() != fp) return false;
+            }
+
+            // Check the other files.
+            std::vector<fs::path> dependencies;
+            if (!read_number(in, count)) return false;
+            for (std::size_t i = 0; i < count; ++i) {
+                std::string path;
+                bool found;
+                fingerprint::value_type fp;
+                if (!read_string(in, path) || !read_number(in, found) ||
+                    !read_number(in, fp))
+                    return false;
+
+                dependencies.push_back(detail::generic_to_path(path));
+                if (fs::exists(dependencies.back()) != found) return false;
+
+                fingerprint current;
+                if (found &&
+                    (!file_fingerprint(dependencies.back(), current) ||
+                     current.value() != fp))
+                    return false;
+            }
+
+            // Read the rest of the entry.
+            std::vector<document_event> events;
+            if (!read_number(in, count)) return false;
+            for (std::size_t i = 0; i < count; ++i) {
+                events.push_back(document_event(document_event::end_file));
+                if (!read_event(in, events.back(), file, state.order_pos))
+                    return false;
+            }
+
+            unsigned order_count;
+            bool warned_about_breaks;
+            std::size_t placeholder_count;
+            std::string output;
+            if (!read_number(in, order_count) ||
+                !read_number(in, warned_about_breaks) ||
+                !read_number(in, placeholder_count) ||
+                !read_string(in, output))
+                return false;
+
+            std::string renumbered;
+            if (!state.document.renumber_placeholders(
+                    output, 0,
+                    static_cast<std::ptrdiff_t>(
+                        state.document.placeholder_count()),
+                    renumbered))
+                return false;
+
+            // Everything's valid, so update the state.
+            std::size_t first_placeholder = state.document.placeholder_count();
+            QUICKBOOK_FOR (document_event const& e, events) {
+                state.document.replay(e);
+            }
+            assert(
+                state.document.placeholder_count() ==
+                first_placeholder + placeholder_count);
+            quickbook::ignore_variable(&first_placeholder);
+
+            QUICKBOOK_FOR (fs::path const& p, dependencies) {
+                state.dependencies.add_dependency(p);
+            }
+
+            state.order_pos += order_count;
+            if (warned_about_breaks) state.warned_about_breaks = true;
+
+            std::string const revision = default_last_revision();
+            std::size_t const output_pos = state.out.str().size();
+            std::string result;
+            std::string::size_type pos = 0, next;
+            while ((next = renumbered.find(revision_marker, pos)) !=
+                   std::string::npos) {
+                result.append(renumbered, pos, next - pos);
+                state.last_revisions.push_back(output_pos + result.size());
+                result += revision;
+                pos = next + 1;
+            }
+            result.append(renumbered, pos, std::string::npos);
+            state.out << result;
+            return true;
+        } catch (std::exception&) {
+            return false;
+        }
+    }
+
+    void cached_include::store()
+    {
+        if (!recording) return;
+
+        // Check that the file didn't do anything that the cache can't
+        // replay.
+        std::vector<document_event> const& events =
+            state.document.recorded_events();
+
+        // Note: The file isn't parsed if there was an earlier error, so
+        // check that before checking the file's version.
+        bool valid =
+            state.error_count == error_start &&
+            detail::diagnostic_count() == diagnostic_start &&
+            file->version() >= 106u &&
+            state.time_dependent_output == time_dependent_start &&
+            state.dependencies.glob_count() == glob_start &&
+            state.anchors.empty() && state.phrase.str().empty() &&
+            !state.callout_depth && state.explicit_list == explicit_list &&
+            state.in_list == in_list &&
+            state.source_mode_next == source_mode_next &&
+            check_events(events.begin() + event_start, events.end());
+
+        std::string output;
+        if (valid) {
+            std::string marked(state.out.str(), output_start);
+            valid = marked.find(revision_marker) == std::string::npos;
+
+            // Replace the last revisions from the end, so that the earlier
+            // positions are still valid.
+            std::string const revision = default_last_revision();
+            std::size_t end = marked.size();
+            for (std::size_t i = state.last_revisions.size();
+                 valid && i > last_revision_start; --i) {
+                std::size_t pos = state.last_revisions[i - 1];
+                valid = pos >= output_start &&
+                        pos - output_start + revision.size() <= end &&
+                        !marked.compare(
+                            pos - output_start, revision.size(), revision);
+                if (valid) {
+                    end = pos - output_start;
+                    marked.replace(end, revision.size(), 1, revision_marker);
+                }
+            }
+
+            valid = valid && state.document.renumber_placeholders(
+                                 marked, placeholder_start,
+                                 -static_cast<std::ptrdiff_t>(
+                                     placeholder_start),
+                                 output);
+        }
+
+        std::vector<template_symbol const*> used;
+        state.templates.recorded_templates(templates, used);
+
+        if (valid) {
+            try {
+                fs::path tmp_path = cache_path;
+                tmp_path += ".tmp";
+                fs::ofstream out(tmp_path, std::ios_base::binary);
+                if (!out) return;
+
+                write_string(out, cache_format);
+
+                std::map<std::string, fingerprint::value_type> templates;
+                QUICKBOOK_FOR (template_symbol const* t, used) {
+                    templates[t->identifier] = template_fingerprint(*t).value();
+                }
+                write_number(out, templates.size());
+                typedef std::map<std::string, fingerprint::value_type>::
+                    value_type template_entry;
+                QUICKBOOK_FOR (template_entry const& t, templates) {
+                    write_string(out, t.first);
+                    write_number(out, t.second);
+                }
+
+                std::map<fs::path, bool> dependencies;
+                std::vector<std::pair<fs::path, bool> > const& history =
+                    state.dependencies.history();
+                for (std::size_t i = dependency_start; i < history.size();
+                     ++i) {
+                    dependencies[history[i].first] |= history[i].second;
+                }
+                write_number(out, dependencies.size());
+                typedef std::map<fs::path, bool>::value_type dependency;
+                QUICKBOOK_FOR (dependency const& d, dependencies) {
+                    fingerprint fp;
+                    if (d.second && !file_fingerprint(d.first, fp)) {
+                        out.close();
+                        fs::remove(tmp_path);
+                        return;
+                    }
+                    write_string(out, detail::path_to_generic(d.first));
+                    write_number(out, d.second);
+                    write_number(out, fp.value());
+                }
+
+                write_number(out, events.size() - event_start);
+                for (std::size_t i = event_start; i < events.size(); ++i) {
+                    if (!write_event(out, events[i], file, order_start)) {
+                        out.close();
+                        fs::remove(tmp_path);
+                        return;
+                    }
+                }
+
+                write_number(out, state.order_pos - order_start);
+                write_number(out, state.warned_about_breaks);
+                write_number(
+                    out,
+                    state.document.placeholder_count() - placeholder_start);
+                write_string(out, output);
+
+                out.close();
+                if (out.fail()) {
+                    fs::remove(tmp_path);
+                    return;
+                }
+                fs::rename(tmp_path, cache_path);
+            } catch (std::exception&) {
+                // The cache is just an optimization, so failing to write to
+                // it isn't an error.
+            }
+        }
+
+        stop_recording();
+    }
+}
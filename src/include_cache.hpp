@@ -0,0 +1,80 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(QUICKBOOK_INCLUDE_CACHE_HPP)
+#define QUICKBOOK_INCLUDE_CACHE_HPP
+
+#include "fwd.hpp"
+#include "include_paths.hpp"
+#include "template_stack.hpp"
+#include "values.hpp"
+
+namespace quickbook
+{
+    // cached_include
+    //
+    // Caches the output of a quickbook 1.6+ included file, so that it doesn't
+    // have to be parsed again if it hasn't changed.
+    //
+    // The cache is keyed on the file's contents and the state it's included
+    // in. This is checked when the object is constructed, and if there's a
+    // valid entry the output and the changes made to the document state are
+    // replayed. Otherwise, the file should be parsed as normal, and then
+    // 'store' called to cache the result.
+    //
+    // A cache entry also checks the inherited templates that the file used,
+    // and the other files that it depends on. It isn't stored if anything
+    // happened which the cache can't replay, such as an error or warning.
+    //
+    // Entries are never removed, the cache directory has to be cleaned by
+    // the user.
+
+    struct cached_include
+    {
+        cached_include(
+            quickbook::state&,
+            quickbook_path const&,
+            value::tag_type load_type,
+            value const& include_doc_id);
+        ~cached_include();
+
+        bool replayed() const { return replayed_; }
+        void store();
+
+      private:
+        bool replay();
+        void stop_recording();
+
+        quickbook::state& state;
+        bool recording;
+        bool replayed_;
+        file_ptr file;
+        fs::path cache_path;
+
+        // State at the start of the file.
+        std::size_t output_start;
+        std::size_t placeholder_start;
+        std::size_t event_start;
+        std::size_t dependency_start;
+        std::size_t last_revision_start;
+        unsigned diagnostic_start;
+        int error_start;
+        int time_dependent_start;
+        std::size_t glob_start;
+        unsigned order_start;
+        bool explicit_list;
+        bool in_list;
+        source_mode_type source_mode_next;
+        template_stack::recording templates;
+
+        cached_include(cached_include const&);
+        cached_include& operator=(cached_include const&);
+    };
+}
+
+#endif
@@ -184,6 +184,45 @@ namespace quickbook
         }
     }
 
+    bool search_include_path(
+        std::set<quickbook_path>& result,
+        std::string const& value,
+        quickbook::state& state)
+    {
+        fs::path path = detail::generic_to_path(value);
+
+        // If the path is relative, try and resolve it.
+        if (!path.has_root_directory() && !path.has_root_name()) {
+            quickbook_path path2 = state.current_path.parent_path() / value;
+
+            // See if it can be found locally first.
+            if (state.dependencies.add_dependency(path2.file_path)) {
+                result.insert(path2);
+                return true;
+            }
+
+            // Search in each of the include path locations.
+            unsigned count = 0;
+            QUICKBOOK_FOR (fs::path full, include_path) {
+                ++count;
+                full /= path;
+
+                if (state.dependencies.add_dependency(full)) {
+                    result.insert(quickbook_path(full, count, path));
+                    return true;
+                }
+            }
+        }
+        else {
+            if (state.dependencies.add_dependency(path)) {
+                result.insert(quickbook_path(path, 0, path));
+                return true;
+            }
+        }
+
+        return false;
+    }
+
     std::set<quickbook_path> include_search(
         path_parameter const& parameter,
         quickbook::state& state,
@@ -218,45 +257,14 @@ namespace quickbook
                 return result;
             }
 
-        case path_parameter::path: {
-            fs::path path = detail::generic_to_path(parameter.value);
-
-            // If the path is relative, try and resolve it.
-            if (!path.has_root_directory() && !path.has_root_name()) {
-                quickbook_path path2 =
-                    state.current_path.parent_path() / parameter.value;
-
-                // See if it can be found locally first.
-                if (state.dependencies.add_dependency(path2.file_path)) {
-                    result.insert(path2);
-                    return result;
-                }
-
-                // Search in each of the include path locations.
-                unsigned count = 0;
-                QUICKBOOK_FOR (fs::path full, include_path) {
-                    ++count;
-                    full /= path;
-
-                    if (state.dependencies.add_dependency(full)) {
-                        result.insert(quickbook_path(full, count, path));
-                        return result;
-                    }
-                }
-            }
-            else {
-                if (state.dependencies.add_dependency(path)) {
-                    result.insert(quickbook_path(path, 0, path));
-                    return result;
-                }
+        case path_parameter::path:
+            if (!search_include_path(result, parameter.value, state)) {
+                detail::outerr(state.current_file, pos)
+                    << "Unable to find file: " << parameter.value << std::endl;
+                ++state.error_count;
             }
 
-            detail::outerr(state.current_file, pos)
-                << "Unable to find file: " << parameter.value << std::endl;
-            ++state.error_count;
-
             return result;
-        }
 
         case path_parameter::invalid:
             return result;
@@ -75,6 +75,13 @@ namespace quickbook
     std::set<quickbook_path> include_search(
         path_parameter const&, quickbook::state& state, string_iterator pos);
 
+    // Search for a plain path, in the same manner as 'include_search', but
+    // return false instead of reporting an error if it isn't found.
+    bool search_include_path(
+        std::set<quickbook_path>& result,
+        std::string const& path,
+        quickbook::state& state);
+
     quickbook_path resolve_xinclude_path(
         std::string const&, quickbook::state&, bool is_file = false);
 }
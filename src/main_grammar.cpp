@@ -161,7 +161,10 @@ namespace quickbook
     struct process_element_impl : scoped_action_base
     {
         process_element_impl(main_grammar_local& l_)
-            : l(l_), pushed_source_mode_(false), element_context_error_(false)
+            : l(l_)
+            , pushed_source_mode_(false)
+            , element_context_error_(false)
+            , profiling_(false)
         {
         }
 
@@ -197,6 +200,11 @@ namespace quickbook
                 l.state_.source_mode_next = 0;
             }
 
+            if (l.state_.profiler.enabled()) {
+                l.state_.profiler.start(l.state_.output_size());
+                profiling_ = true;
+            }
+
             return true;
         }
 
@@ -226,11 +234,22 @@ namespace quickbook
             }
         }
 
-        void success(parse_iterator, parse_iterator)
+        void success(parse_iterator first, parse_iterator last)
         {
             l.element_type = info_.type;
+
+            if (profiling_) {
+                l.state_.profiler.stop(
+                    l.state_.current_file, first.base(), last.base(),
+                    l.state_.output_size());
+            }
+        }
+
+        void failure()
+        {
+            l.element_type = element_info::nothing;
+            if (profiling_) l.state_.profiler.cancel();
         }
-        void failure() { l.element_type = element_info::nothing; }
 
         void cleanup()
         {
@@ -241,6 +260,7 @@ namespace quickbook
         element_info info_;
         bool pushed_source_mode_;
         bool element_context_error_;
+        bool profiling_;
     };
 
     struct scoped_paragraph : scoped_action_base
@@ -267,6 +287,42 @@ namespace quickbook
         bool pushed;
     };
 
+    // Charges the cost of parsing a block to its source in the profile.
+    struct profile_block_impl : scoped_action_base
+    {
+        profile_block_impl(quickbook::state& state_)
+            : state(state_), profiling(false)
+        {
+        }
+
+        bool start()
+        {
+            if (state.profiler.enabled()) {
+                state.profiler.start(state.output_size());
+                profiling = true;
+            }
+
+            return true;
+        }
+
+        void success(parse_iterator first, parse_iterator last)
+        {
+            if (profiling) {
+                state.profiler.stop(
+                    state.current_file, first.base(), last.base(),
+                    state.output_size());
+            }
+        }
+
+        void failure()
+        {
+            if (profiling) state.profiler.cancel();
+        }
+
+        quickbook::state& state;
+        bool profiling;
+    };
+
     struct in_list_impl
     {
         main_grammar_local& l;
@@ -342,6 +398,7 @@ namespace quickbook
 
         scoped_parser<to_value_scoped_action> to_value(state);
         scoped_parser<scoped_paragraph> scope_paragraph(state);
+        scoped_parser<profile_block_impl> profile_block(state);
 
         quickbook_strict strict_mode(state);
 
@@ -475,7 +532,8 @@ namespace quickbook
 
         local.top_level =
                 cl::eps_p(local.indent_check)
-            >>  (   cl::eps_p(ph::var(local.block_type) == block_types::code)
+            >>  profile_block()
+                [   cl::eps_p(ph::var(local.block_type) == block_types::code)
                 >>  local.code
                 |   cl::eps_p(ph::var(local.block_type) == block_types::list)
                 >>  local.list
@@ -483,7 +541,7 @@ namespace quickbook
                 >>  (   local.hr
                     |   local.paragraph
                     )
-                )
+                ]
             >>  *eol
             ;
 
@@ -20,12 +20,14 @@
 #include <boost/version.hpp>
 #include "actions.hpp"
 #include "bb2html.hpp"
+#include "dependency_scanner.hpp"
 #include "document_state.hpp"
 #include "files.hpp"
 #include "for.hpp"
 #include "grammar.hpp"
 #include "path.hpp"
 #include "post_process.hpp"
+#include "server.hpp"
 #include "state.hpp"
 #include "stream.hpp"
 #include "utils.hpp"
@@ -43,8 +45,6 @@
 #pragma warning(disable : 4355)
 #endif
 
-#define QUICKBOOK_VERSION "Quickbook Version 1.7.2"
-
 namespace quickbook
 {
     namespace cl = boost::spirit::classic;
@@ -58,11 +58,31 @@ namespace quickbook
     std::vector<std::string> preset_defines;
     fs::path image_location;
 
+    // Set the globals back to their initial values, so that a command run by
+    // the server doesn't use the settings from the server's command line.
+    static void reset_globals()
+    {
+        current_time = 0;
+        current_gm_time = 0;
+        debug_mode = false;
+        self_linked_headers = false;
+        include_path.clear();
+        preset_defines.clear();
+        image_location = fs::path();
+        detail::set_ms_errors(false);
+        detail::set_max_diagnostics(0);
+        detail::set_diagnostics_format(detail::diagnostic_sink::text);
+    }
+
     static void set_macros(quickbook::state& state)
     {
         QUICKBOOK_FOR (quickbook::string_view val, preset_defines) {
-            parse_iterator first(val.begin());
-            parse_iterator last(val.end());
+            // Parse each definition from its own file, so that the values
+            // built from it have a file to refer to.
+            state.current_file =
+                new file("(command line)", val, qbk_version_n);
+            parse_iterator first(state.current_file->source().begin());
+            parse_iterator last(state.current_file->source().end());
 
             cl::parse_info<parse_iterator> info =
                 cl::parse(first, last, state.grammar().command_line_macro);
@@ -73,6 +93,8 @@ namespace quickbook
                 ++state.error_count;
             }
         }
+
+        state.current_file = 0;
     }
 
     ///////////////////////////////////////////////////////////////////////////
@@ -133,6 +155,9 @@ namespace quickbook
             , pretty_print(true)
             , strict_mode(false)
             , deps_out_flags(quickbook::dependency_tracker::default_)
+            , scan_deps(false)
+            , profile_format(quickbook::source_profiler::text)
+            , profile_lines(-1)
         {
         }
 
@@ -145,8 +170,13 @@ namespace quickbook
         bool strict_mode;
         fs::path deps_out;
         quickbook::dependency_tracker::flags deps_out_flags;
+        bool scan_deps;
         fs::path locations_out;
+        fs::path profile_out;
+        quickbook::source_profiler::format profile_format;
+        int profile_lines;
         fs::path xinclude_base;
+        fs::path include_cache;
         quickbook::detail::html_options html_ops;
     };
 
@@ -162,16 +192,27 @@ namespace quickbook
             quickbook::state state(
                 filein_, options_.xinclude_base, buffer, output);
             state.strict_mode = options_.strict_mode;
+            if (!options_.profile_out.empty()) state.profiler.enable();
+            state.include_cache_dir = options_.include_cache;
             set_macros(state);
 
             if (state.error_count == 0) {
                 state.dependencies.add_dependency(filein_);
                 state.current_file = load(filein_); // Throws load_error
 
-                parse_file(state);
+                if (!options_.scan_deps || !scan_dependencies(state)) {
+                    if (options_.scan_deps) {
+                        // The scan couldn't find everything, so fall back
+                        // to a full parse.
+                        state.dependencies.clear();
+                        state.dependencies.add_dependency(filein_);
+                    }
+
+                    parse_file(state);
+                }
 
                 if (state.error_count) {
-                    detail::outerr()
+                    detail::outsummary()
                         << "Error count: " << state.error_count << ".\n";
                 }
             }
@@ -188,6 +229,20 @@ namespace quickbook
                 state.dependencies.write_dependencies(
                     options_.locations_out, dependency_tracker::checked);
             }
+
+            if (!options_.profile_out.empty()) {
+                // By default, the text profile is limited to the most
+                // expensive lines, the json profile has all of them.
+                int lines = options_.profile_lines;
+                if (lines < 0)
+                    lines = options_.profile_format ==
+                                    quickbook::source_profiler::text
+                                ? 20
+                                : 0;
+                state.profiler.write_report(
+                    options_.profile_out, options_.profile_format,
+                    static_cast<unsigned>(lines));
+            }
         } catch (load_error& e) {
             detail::outerr(filein_) << e.what() << std::endl;
             result = 1;
@@ -196,6 +251,10 @@ namespace quickbook
             result = 1;
         }
 
+        // Write the diagnostics from parsing before generating the output,
+        // which might write its own messages.
+        detail::flush_diagnostics();
+
         if (result) {
             return result;
         }
@@ -221,6 +280,8 @@ namespace quickbook
                 }
             }
 
+            detail::flush_diagnostics();
+
             if (options_.format == parse_document_options::html) {
                 if (result) {
                     return result;
@@ -260,8 +321,31 @@ namespace quickbook
 //  Main program
 //
 ///////////////////////////////////////////////////////////////////////////
+static int run_command_line(int argc, char* argv[], bool server_child);
+
+// Run a command for a client of the server.
+static int run_server_command(int argc, char* argv[])
+{
+    int result = run_command_line(argc, argv, true);
+    quickbook::detail::finish_diagnostics();
+    return result;
+}
+
 int main(int argc, char* argv[])
 {
+    // Various initialisation methods
+    quickbook::detail::initialise_output();
+    quickbook::detail::initialise_markups();
+
+    int result = run_command_line(argc, argv, false);
+    quickbook::detail::finish_diagnostics();
+    return result;
+}
+
+static int run_command_line(int argc, char* argv[], bool server_child)
+{
+    quickbook::reset_globals();
+
     try {
         namespace fs = boost::filesystem;
         namespace po = boost::program_options;
@@ -278,14 +362,6 @@ int main(int argc, char* argv[])
         using namespace quickbook;
         using quickbook::detail::command_line_string;
 
-        // First thing, the filesystem should record the current working
-        // directory.
-        fs::initial_path<fs::path>();
-
-        // Various initialisation methods
-        quickbook::detail::initialise_output();
-        quickbook::detail::initialise_markups();
-
         // Declare the program options
 
         options_description desc("Allowed options");
@@ -315,10 +391,20 @@ int main(int argc, char* argv[])
             ("output-dir", PO_VALUE<command_line_string>(), "output directory (for html)")
             ("no-output", "don't write out the result")
             ("output-deps", PO_VALUE<command_line_string>(), "output dependency file")
+            ("scan-deps", "only scan the document for dependencies, don't parse it")
+            ("output-source-profile", PO_VALUE<command_line_string>(), "output the time and output size for each part of the source")
+            ("output-source-profile-format", PO_VALUE<command_line_string>(), "format for output-source-profile: text, json")
+            ("output-source-profile-lines", PO_VALUE<int>(), "number of line ranges to list for each file in output-source-profile, 0 for all")
+            ("include-cache", PO_VALUE<command_line_string>(), "directory to cache the output of included files in")
             ("ms-errors", "use Microsoft Visual Studio style error & warn message format")
+            ("max-diagnostics", PO_VALUE<int>(), "maximum number of distinct errors and warnings to write")
+            ("diagnostics-format", PO_VALUE<command_line_string>(), "format for errors and warnings: text, json")
             ("include-path,I", PO_VALUE< std::vector<command_line_string> >(), "include path")
             ("define,D", PO_VALUE< std::vector<command_line_string> >(), "define macro")
             ("image-location", PO_VALUE<command_line_string>(), "image location")
+            ("server", PO_VALUE<command_line_string>(), "run a server which compiles documents for clients connecting to the given socket")
+            ("preload-file", PO_VALUE< std::vector<command_line_string> >(), "file for the server to read before it starts, it isn't parsed")
+            ("connect", PO_VALUE<command_line_string>(), "run the command in the server listening on the given socket")
         ;
 
         html_desc.add_options()
@@ -413,6 +499,97 @@ int main(int argc, char* argv[])
 
         quickbook::detail::set_ms_errors(vm.count("ms-errors"));
 
+        if (vm.count("max-diagnostics")) {
+            int max_diagnostics = vm["max-diagnostics"].as<int>();
+            if (max_diagnostics < 0) {
+                quickbook::detail::outerr()
+                    << "max-diagnostics must not be negative" << std::endl;
+
+                ++error_count;
+            }
+            else {
+                quickbook::detail::set_max_diagnostics(
+                    static_cast<unsigned>(max_diagnostics));
+            }
+        }
+
+        if (vm.count("diagnostics-format")) {
+            std::string format = quickbook::detail::command_line_to_utf8(
+                vm["diagnostics-format"].as<command_line_string>());
+
+            if (format == "text") {
+                quickbook::detail::set_diagnostics_format(
+                    quickbook::detail::diagnostic_sink::text);
+            }
+            else if (format == "json") {
+                quickbook::detail::set_diagnostics_format(
+                    quickbook::detail::diagnostic_sink::json);
+            }
+            else {
+                quickbook::detail::outerr()
+                    << "Unknown diagnostics format: " << format << std::endl;
+
+                ++error_count;
+            }
+        }
+
+        if (vm.count("connect") && !server_child) {
+            // If the server isn't running, the command is run locally.
+            int exit_code;
+            if (quickbook::detail::run_client(
+                    quickbook::detail::command_line_to_path(
+                        vm["connect"].as<command_line_string>()),
+                    argc, argv, exit_code)) {
+                return exit_code;
+            }
+        }
+
+        if (vm.count("server")) {
+            if (server_child) {
+                quickbook::detail::outerr()
+                    << "server given in a command sent to the server"
+                    << std::endl;
+                return 1;
+            }
+
+            if (vm.count("input-file")) {
+                quickbook::detail::outerr()
+                    << "input file given for server" << std::endl;
+                return 1;
+            }
+
+            if (vm.count("preload-file")) {
+                std::vector<command_line_string> const& files =
+                    vm["preload-file"].as<std::vector<command_line_string> >();
+                QUICKBOOK_FOR (command_line_string const& x, files) {
+                    fs::path path = quickbook::detail::command_line_to_path(x);
+                    try {
+                        quickbook::cache_source(path);
+                    } catch (load_error& e) {
+                        quickbook::detail::outerr(path)
+                            << e.what() << std::endl;
+                        ++error_count;
+                    }
+                }
+            }
+
+            if (error_count) {
+                return 1;
+            }
+
+            quickbook::detail::finish_diagnostics();
+
+            return quickbook::detail::run_server(
+                quickbook::detail::command_line_to_path(
+                    vm["server"].as<command_line_string>()),
+                &run_server_command);
+        }
+
+        // The filesystem should record the current working directory. This
+        // is after the server has been started, so that a command run by the
+        // server records the client's directory.
+        fs::initial_path<fs::path>();
+
         if (vm.count("no-pretty-print")) options.pretty_print = false;
 
         options.strict_mode = !!vm.count("strict");
@@ -467,8 +644,10 @@ int main(int argc, char* argv[])
         }
         else {
             time_t t = std::time(0);
-            static tm lt = *localtime(&t);
-            static tm gmt = *gmtime(&t);
+            static tm lt;
+            static tm gmt;
+            lt = *localtime(&t);
+            gmt = *gmtime(&t);
             quickbook::current_time = &lt;
             quickbook::current_gm_time = &gmt;
             quickbook::debug_mode = false;
@@ -538,12 +717,70 @@ int main(int argc, char* argv[])
                     quickbook::dependency_tracker::flags(flags);
             }
 
+            if (vm.count("output-source-profile")) {
+                alt_output_specified = true;
+                options.profile_out = quickbook::detail::command_line_to_path(
+                    vm["output-source-profile"].as<command_line_string>());
+            }
+
+            if (vm.count("output-source-profile-format")) {
+                std::string format = quickbook::detail::command_line_to_utf8(
+                    vm["output-source-profile-format"]
+                        .as<command_line_string>());
+
+                if (format == "text") {
+                    options.profile_format = quickbook::source_profiler::text;
+                }
+                else if (format == "json") {
+                    options.profile_format = quickbook::source_profiler::json;
+                }
+                else {
+                    quickbook::detail::outerr()
+                        << "Unknown source profile format: " << format
+                        << std::endl;
+
+                    ++error_count;
+                }
+            }
+
+            if (vm.count("output-source-profile-lines")) {
+                options.profile_lines =
+                    vm["output-source-profile-lines"].as<int>();
+
+                if (options.profile_lines < 0) {
+                    quickbook::detail::outerr()
+                        << "output-source-profile-lines must not be negative"
+                        << std::endl;
+
+                    ++error_count;
+                }
+            }
+
             if (vm.count("output-checked-locations")) {
                 alt_output_specified = true;
                 options.locations_out = quickbook::detail::command_line_to_path(
                     vm["output-checked-locations"].as<command_line_string>());
             }
 
+            if (vm.count("scan-deps")) {
+                options.scan_deps = true;
+
+                if (options.deps_out.empty() && options.locations_out.empty()) {
+                    quickbook::detail::outerr()
+                        << "scan-deps given without output-deps or "
+                           "output-checked-locations"
+                        << std::endl;
+                    ++error_count;
+                }
+
+                if (output_specified || vm.count("output-file") ||
+                    vm.count("output-dir")) {
+                    quickbook::detail::outerr()
+                        << "scan-deps given with document output" << std::endl;
+                    ++error_count;
+                }
+            }
+
             if (vm.count("boost-root-path")) {
                 // TODO: Check that it's a directory?
                 options.html_ops.boost_root_path =
@@ -705,6 +942,19 @@ int main(int argc, char* argv[])
                 assert(error_count || fs::is_directory(options.xinclude_base));
             }
 
+            if (vm.count("include-cache")) {
+                options.include_cache = quickbook::detail::command_line_to_path(
+                    vm["include-cache"].as<command_line_string>());
+
+                boost::system::error_code ec;
+                fs::create_directories(options.include_cache, ec);
+                if (!fs::is_directory(options.include_cache)) {
+                    quickbook::detail::outerr()
+                        << "include-cache is not a directory" << std::endl;
+                    ++error_count;
+                }
+            }
+
             if (vm.count("image-location")) {
                 quickbook::image_location =
                     quickbook::detail::command_line_to_path(
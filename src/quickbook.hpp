@@ -19,6 +19,8 @@
 #include "fwd.hpp"
 #include "values.hpp"
 
+#define QUICKBOOK_VERSION "Quickbook Version 1.7.2"
+
 namespace quickbook
 {
     namespace fs = boost::filesystem;
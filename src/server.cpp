@@ -0,0 +1,392 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "server.hpp"
+#include "for.hpp"
+#include "stream.hpp"
+
+#if !defined(_WIN32)
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/range/iterator_range.hpp>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace quickbook
+{
+    namespace detail
+    {
+#if defined(_WIN32)
+        int run_server(fs::path const&, command_function)
+        {
+            outerr() << "server isn't supported on this platform" << std::endl;
+            return 1;
+        }
+
+        bool run_client(fs::path const&, int, char*[], int&) { return false; }
+#else
+        // The client sends a single byte, with its standard input, output
+        // and error attached, followed by the number of strings, then the
+        // strings - its working directory and then its arguments. Each
+        // string is its length followed by its contents. The server replies
+        // with the command's exit code once the command has finished.
+
+        namespace
+        {
+            int const stream_count = 3;
+            boost::uint32_t const max_strings = 0x10000;
+            boost::uint32_t const max_string_length = 0x100000;
+
+            bool make_address(sockaddr_un& address, fs::path const& path)
+            {
+                std::memset(&address, 0, sizeof(address));
+                address.sun_family = AF_UNIX;
+                std::string const& native = path.native();
+                if (native.empty() ||
+                    native.size() >= sizeof(address.sun_path)) {
+                    return false;
+                }
+                std::memcpy(address.sun_path, native.data(), native.size());
+                return true;
+            }
+
+            bool write_all(int fd, void const* data, std::size_t size)
+            {
+                char const* it = static_cast<char const*>(data);
+                while (size) {
+                    ssize_t n = ::write(fd, it, size);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) return false;
+                    it += n;
+                    size -= n;
+                }
+                return true;
+            }
+
+            bool read_all(int fd, void* data, std::size_t size)
+            {
+                char* it = static_cast<char*>(data);
+                while (size) {
+                    ssize_t n = ::read(fd, it, size);
+                    if (n < 0 && errno == EINTR) continue;
+                    if (n <= 0) return false;
+                    it += n;
+                    size -= n;
+                }
+                return true;
+            }
+
+            bool write_string(int fd, std::string const& x)
+            {
+                boost::uint32_t size = static_cast<boost::uint32_t>(x.size());
+                return write_all(fd, &size, sizeof(size)) &&
+                       write_all(fd, x.data(), x.size());
+            }
+
+            bool read_string(int fd, std::string& x)
+            {
+                boost::uint32_t size;
+                if (!read_all(fd, &size, sizeof(size)) ||
+                    size > max_string_length) {
+                    return false;
+                }
+                x.resize(size);
+                return read_all(fd, &x[0], size);
+            }
+
+            bool send_streams(int fd)
+            {
+                int streams[stream_count] = {0, 1, 2};
+                char byte = 0;
+                iovec io;
+                io.iov_base = &byte;
+                io.iov_len = 1;
+
+                union
+                {
+                    char buffer[CMSG_SPACE(sizeof(streams))];
+                    cmsghdr align;
+                } control;
+                std::memset(&control, 0, sizeof(control));
+
+                msghdr message;
+                std::memset(&message, 0, sizeof(message));
+                message.msg_iov = &io;
+                message.msg_iovlen = 1;
+                message.msg_control = control.buffer;
+                message.msg_controllen = sizeof(control.buffer);
+
+                cmsghdr* header = CMSG_FIRSTHDR(&message);
+                header->cmsg_level = SOL_SOCKET;
+                header->cmsg_type = SCM_RIGHTS;
+                header->cmsg_len = CMSG_LEN(sizeof(streams));
+                std::memcpy(CMSG_DATA(header), streams, sizeof(streams));
+
+                ssize_t n;
+                do {
+                    n = ::sendmsg(fd, &message, 0);
+                } while (n < 0 && errno == EINTR);
+                return n == 1;
+            }
+
+            bool receive_streams(int fd, int (&streams)[stream_count])
+            {
+                char byte;
+                iovec io;
+                io.iov_base = &byte;
+                io.iov_len = 1;
+
+                union
+                {
+                    char buffer[CMSG_SPACE(sizeof(streams))];
+                    cmsghdr align;
+                } control;
+
+                msghdr message;
+                std::memset(&message, 0, sizeof(message));
+                message.msg_iov = &io;
+                message.msg_iovlen = 1;
+                message.msg_control = control.buffer;
+                message.msg_controllen = sizeof(control.buffer);
+
+                ssize_t n;
+                do {
+                    n = ::recvmsg(fd, &message, 0);
+                } while (n < 0 && errno == EINTR);
+
+                cmsghdr* header = CMSG_FIRSTHDR(&message);
+                if (n != 1 || !header || header->cmsg_level != SOL_SOCKET ||
+                    header->cmsg_type != SCM_RIGHTS ||
+                    header->cmsg_len != CMSG_LEN(sizeof(streams))) {
+                    return false;
+                }
+                std::memcpy(streams, CMSG_DATA(header), sizeof(streams));
+                return true;
+            }
+
+            // Only commands from the user running the server are accepted,
+            // as they're run with the server's permissions.
+            bool same_user(int connection)
+            {
+#if defined(__linux__)
+                ucred credentials;
+                socklen_t size = sizeof(credentials);
+                return ::getsockopt(
+                           connection, SOL_SOCKET, SO_PEERCRED, &credentials,
+                           &size) == 0 &&
+                       size == sizeof(credentials) &&
+                       credentials.uid == ::geteuid();
+#else
+                uid_t uid;
+                gid_t gid;
+                return ::getpeereid(connection, &uid, &gid) == 0 &&
+                       uid == ::geteuid();
+#endif
+            }
+
+            // Run in the child process, returns the exit code.
+            int handle_request(int connection, command_function command)
+            {
+                int streams[stream_count];
+                if (!receive_streams(connection, streams)) {
+                    return 1;
+                }
+
+                boost::uint32_t count;
+                std::vector<std::string> strings;
+                bool valid = read_all(connection, &count, sizeof(count)) &&
+                             count >= 2 && count <= max_strings;
+                if (valid) {
+                    strings.resize(count);
+                    QUICKBOOK_FOR (std::string& x, strings) {
+                        if (!read_string(connection, x)) {
+                            valid = false;
+                            break;
+                        }
+                    }
+                }
+
+                for (int i = 0; i < stream_count; ++i) {
+                    ::dup2(streams[i], i);
+                    if (streams[i] >= stream_count) ::close(streams[i]);
+                }
+
+                int exit_code = 1;
+                if (!valid) {
+                    outerr() << "Invalid request from client." << std::endl;
+                }
+                else if (::chdir(strings[0].c_str()) != 0) {
+                    outerr() << "Unable to change to the client's directory: "
+                             << strings[0] << std::endl;
+                }
+                else {
+                    std::vector<char*> argv;
+                    QUICKBOOK_FOR (
+                        std::string& x,
+                        boost::make_iterator_range(
+                            strings.begin() + 1, strings.end())) {
+                        argv.push_back(&x[0]);
+                    }
+                    argv.push_back(0);
+
+                    exit_code =
+                        command(static_cast<int>(argv.size() - 1), &argv[0]);
+                }
+
+                // Make sure that all the output has been written before the
+                // client exits.
+                finish_diagnostics();
+                std::cout.flush();
+                std::clog.flush();
+                std::cerr.flush();
+
+                boost::int32_t reply = exit_code;
+                write_all(connection, &reply, sizeof(reply));
+                return exit_code;
+            }
+        }
+
+        int run_server(fs::path const& socket_path, command_function command)
+        {
+            sockaddr_un address;
+            if (!make_address(address, socket_path)) {
+                outerr() << "Invalid socket path: " << socket_path
+                         << std::endl;
+                return 1;
+            }
+
+            int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (listener < 0) {
+                outerr() << "Unable to create socket: " << std::strerror(errno)
+                         << std::endl;
+                return 1;
+            }
+
+            // Remove a socket left behind by a previous server, but nothing
+            // else.
+            struct stat status;
+            if (::lstat(address.sun_path, &status) == 0 &&
+                S_ISSOCK(status.st_mode)) {
+                ::unlink(address.sun_path);
+            }
+
+            // Create the socket so that only the current user can connect.
+            mode_t mask = ::umask(077);
+            int bound = ::bind(
+                listener, reinterpret_cast<sockaddr*>(&address),
+                sizeof(address));
+            ::umask(mask);
+
+            if (bound != 0 || ::listen(listener, SOMAXCONN) != 0) {
+                outerr() << "Unable to listen on socket " << socket_path
+                         << ": " << std::strerror(errno) << std::endl;
+                ::close(listener);
+                return 1;
+            }
+
+            // Children are never waited for.
+            ::signal(SIGCHLD, SIG_IGN);
+
+            out() << "Listening on socket: " << socket_path << std::endl;
+            std::cout.flush();
+            std::clog.flush();
+
+            while (true) {
+                int connection = ::accept(listener, 0, 0);
+                if (connection < 0) {
+                    if (errno == EINTR || errno == ECONNABORTED) continue;
+                    outerr() << "Error accepting connection: "
+                             << std::strerror(errno) << std::endl;
+                    ::close(listener);
+                    return 1;
+                }
+
+                if (!same_user(connection)) {
+                    outerr() << "Rejected connection from another user."
+                             << std::endl;
+                    finish_diagnostics();
+                    ::close(connection);
+                    continue;
+                }
+
+                pid_t pid = ::fork();
+                if (pid == 0) {
+                    ::signal(SIGCHLD, SIG_DFL);
+                    ::close(listener);
+                    int exit_code = handle_request(connection, command);
+                    ::close(connection);
+                    return exit_code;
+                }
+
+                if (pid < 0) {
+                    outerr() << "Unable to fork: " << std::strerror(errno)
+                             << std::endl;
+                    finish_diagnostics();
+                }
+                ::close(connection);
+            }
+        }
+
+        bool run_client(
+            fs::path const& socket_path, int argc, char* argv[], int& exit_code)
+        {
+            sockaddr_un address;
+            if (!make_address(address, socket_path)) {
+                return false;
+            }
+
+            int connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (connection < 0) {
+                return false;
+            }
+
+            if (::connect(
+                    connection, reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address)) != 0) {
+                ::close(connection);
+                return false;
+            }
+
+            // Report a server that has gone away as an error, rather than
+            // being killed.
+            ::signal(SIGPIPE, SIG_IGN);
+
+            boost::uint32_t count = static_cast<boost::uint32_t>(argc) + 1;
+            std::string directory = fs::current_path().native();
+            bool success = send_streams(connection) &&
+                           write_all(connection, &count, sizeof(count)) &&
+                           write_string(connection, directory);
+            for (int i = 0; success && i < argc; ++i) {
+                success = write_string(connection, argv[i]);
+            }
+
+            boost::int32_t reply;
+            success = success && read_all(connection, &reply, sizeof(reply));
+            ::close(connection);
+
+            if (success) {
+                exit_code = reply;
+            }
+            else {
+                outerr() << "Lost connection to server." << std::endl;
+                exit_code = 1;
+            }
+            return true;
+        }
+#endif
+    }
+}
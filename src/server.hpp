@@ -0,0 +1,51 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(QUICKBOOK_SERVER_HPP)
+#define QUICKBOOK_SERVER_HPP
+
+#include <boost/filesystem/path.hpp>
+
+namespace quickbook
+{
+    namespace fs = boost::filesystem;
+
+    namespace detail
+    {
+        // A server for build systems which run quickbook once for each
+        // document.
+        //
+        // The server does the setup that's shared by every document, then
+        // listens on a unix domain socket. For each connection it forks a
+        // child process, which reads the client's command line, working
+        // directory and standard streams, and runs 'command' with them. As
+        // each document is parsed in its own process, nothing needs to be
+        // thread safe, and the children share the server's memory until
+        // they change it.
+        //
+        // Only supported on POSIX systems.
+
+        typedef int (*command_function)(int argc, char* argv[]);
+
+        // Runs until the server is killed, but returns in each child with
+        // the exit code for the command. Returns 1 if the socket couldn't
+        // be created.
+        int run_server(fs::path const& socket_path, command_function command);
+
+        // Sends the command line to the server at 'socket_path', and waits
+        // for it to finish. Returns false if it couldn't connect, so that the
+        // command can be run locally instead.
+        bool run_client(
+            fs::path const& socket_path,
+            int argc,
+            char* argv[],
+            int& exit_code);
+    }
+}
+
+#endif
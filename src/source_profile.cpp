@@ -0,0 +1,283 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include "source_profile.hpp"
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <boost/filesystem/fstream.hpp>
+#include "for.hpp"
+#include "path.hpp"
+#include "utils.hpp"
+
+namespace quickbook
+{
+    namespace
+    {
+        // A range of lines, after mapping the recorded ranges back to
+        // their original source.
+        struct line_cost
+        {
+            line_cost()
+                : file()
+                , first_line(0)
+                , last_line(0)
+                , time(0)
+                , output(0)
+                , count(0)
+            {
+            }
+
+            std::string file;
+            std::ptrdiff_t first_line;
+            std::ptrdiff_t last_line;
+            double time;
+            std::ptrdiff_t output;
+            unsigned count;
+        };
+
+        // File, first line, last line.
+        typedef std::
+            pair<std::string, std::pair<std::ptrdiff_t, std::ptrdiff_t> >
+                line_key;
+
+        bool more_expensive(line_cost const& x, line_cost const& y)
+        {
+            return x.time != y.time ? x.time > y.time : x.output > y.output;
+        }
+
+        void write_text(
+            std::ostream& out,
+            std::vector<line_cost> const& files,
+            std::vector<line_cost> const& lines)
+        {
+            out << "Source profile (time in milliseconds, output in bytes)\n"
+                << "\nFiles:\n\n";
+
+            QUICKBOOK_FOR (line_cost const& x, files) {
+                out << std::setw(12) << std::fixed << std::setprecision(3)
+                    << x.time << std::setw(12) << x.output << "  " << x.file
+                    << "\n";
+            }
+
+            // The lines are grouped by file, in the same order as 'files'.
+            std::string const* current_file = 0;
+            QUICKBOOK_FOR (line_cost const& x, lines) {
+                if (!current_file || *current_file != x.file) {
+                    out << "\nMost expensive lines in " << x.file << ":\n\n";
+                    current_file = &x.file;
+                }
+
+                out << std::setw(12) << std::fixed << std::setprecision(3)
+                    << x.time << std::setw(12) << x.output << "  " << x.file
+                    << ":" << x.first_line;
+                if (x.last_line != x.first_line) out << "-" << x.last_line;
+                if (x.count > 1) out << " (x" << x.count << ")";
+                out << "\n";
+            }
+        }
+
+        void write_json_cost(std::ostream& out, line_cost const& x)
+        {
+            out << "\"file\": \"" << detail::escape_json(x.file) << "\", ";
+            if (x.first_line) {
+                out << "\"first_line\": " << x.first_line << ", "
+                    << "\"last_line\": " << x.last_line << ", "
+                    << "\"count\": " << x.count << ", ";
+            }
+            out << "\"time_ms\": " << std::fixed << std::setprecision(3)
+                << x.time << ", \"output_bytes\": " << x.output;
+        }
+
+        void write_json(
+            std::ostream& out,
+            std::vector<line_cost> const& files,
+            std::vector<line_cost> const& lines)
+        {
+            out << "{\n  \"files\": [";
+            char const* separator = "\n";
+            QUICKBOOK_FOR (line_cost const& x, files) {
+                out << separator << "    {";
+                write_json_cost(out, x);
+                out << "}";
+                separator = ",\n";
+            }
+            out << "\n  ],\n  \"lines\": [";
+            separator = "\n";
+            QUICKBOOK_FOR (line_cost const& x, lines) {
+                out << separator << "    {";
+                write_json_cost(out, x);
+                out << "}";
+                separator = ",\n";
+            }
+            out << "\n  ]\n}\n";
+        }
+    }
+
+    source_profiler::source_profiler() : enabled_(false), frames_(), ranges_()
+    {
+    }
+
+    void source_profiler::start(std::size_t output_size)
+    {
+        frame f;
+        f.start = clock::now();
+        f.output_size = output_size;
+        f.child_time = clock::duration::zero();
+        f.child_output = 0;
+        frames_.push_back(f);
+    }
+
+    void source_profiler::stop(
+        file_ptr const& f,
+        string_iterator first,
+        string_iterator last,
+        std::size_t output_size)
+    {
+        assert(!frames_.empty());
+
+        frame const& top = frames_.back();
+        clock::duration time = clock::now() - top.start;
+        std::ptrdiff_t output = static_cast<std::ptrdiff_t>(output_size) -
+                                static_cast<std::ptrdiff_t>(top.output_size);
+
+        string_iterator begin = f->source().begin();
+        range_key key = {f.get(), static_cast<std::size_t>(first - begin),
+                         static_cast<std::size_t>(last - begin)};
+        range_cost& cost = ranges_[key];
+        if (!cost.count) files_.insert(f);
+        cost.time += time - top.child_time;
+        cost.output += output - top.child_output;
+        ++cost.count;
+
+        frames_.pop_back();
+
+        if (!frames_.empty()) {
+            frames_.back().child_time += time;
+            frames_.back().child_output += output;
+        }
+    }
+
+    void source_profiler::cancel()
+    {
+        assert(!frames_.empty());
+
+        // The parent's own measurement will include this range's time and
+        // output, and any children it had are already in the profile.
+        frame const& top = frames_.back();
+        clock::duration child_time = top.child_time;
+        std::ptrdiff_t child_output = top.child_output;
+
+        frames_.pop_back();
+
+        if (!frames_.empty()) {
+            frames_.back().child_time += child_time;
+            frames_.back().child_output += child_output;
+        }
+    }
+
+    void source_profiler::write_report(
+        fs::path const& path, format fmt, unsigned top_n)
+    {
+        fs::ofstream out(path);
+
+        if (out.fail()) {
+            throw std::runtime_error(
+                "Error opening source profile file " +
+                quickbook::detail::path_to_generic(path));
+        }
+
+        out.exceptions(std::ios::badbit);
+        write_report(out, fmt, top_n);
+    }
+
+    void source_profiler::write_report(
+        std::ostream& out, format fmt, unsigned top_n)
+    {
+        typedef std::map<range_key, range_cost>::value_type range_value;
+        typedef std::chrono::duration<double, std::milli> milliseconds;
+
+        // Merge ranges which cover the same lines, and sum up the costs
+        // for each file.
+        std::map<std::string, line_cost> file_map;
+        std::map<line_key, line_cost> line_map;
+
+        QUICKBOOK_FOR (range_value const& r, ranges_) {
+            string_iterator begin = r.first.f->source().begin();
+            string_iterator first_it = begin + r.first.begin;
+            string_iterator last_it = begin + r.first.end;
+
+            // Ranges often finish with the whitespace which separates them
+            // from whatever follows, so only include the lines up to the
+            // last character that isn't whitespace.
+            while (last_it != first_it &&
+                   (last_it[-1] == ' ' || last_it[-1] == '\t' ||
+                    last_it[-1] == '\n')) {
+                --last_it;
+            }
+
+            file_position first = r.first.f->position_of(first_it);
+            file_position last =
+                last_it == first_it ? first
+                                    : r.first.f->position_of(last_it - 1);
+
+            std::string path = detail::path_to_generic(r.first.f->path);
+            double time = milliseconds(r.second.time).count();
+
+            line_cost& fc = file_map[path];
+            fc.file = path;
+            fc.time += time;
+            fc.output += r.second.output;
+
+            line_cost& lc = line_map[line_key(
+                path, std::make_pair(first.line, last.line))];
+            lc.file = path;
+            lc.first_line = first.line;
+            lc.last_line = last.line;
+            lc.time += time;
+            lc.output += r.second.output;
+            lc.count = (std::max)(lc.count, r.second.count);
+        }
+
+        std::vector<line_cost> files;
+        typedef std::map<std::string, line_cost>::value_type file_value;
+        QUICKBOOK_FOR (file_value const& x, file_map) {
+            files.push_back(x.second);
+        }
+        std::stable_sort(files.begin(), files.end(), more_expensive);
+
+        // Group the lines by file, keeping the 'top_n' most expensive
+        // lines in each one.
+        std::map<std::string, std::vector<line_cost> > file_lines;
+        typedef std::map<line_key, line_cost>::value_type line_value;
+        QUICKBOOK_FOR (line_value const& x, line_map) {
+            file_lines[x.second.file].push_back(x.second);
+        }
+
+        std::vector<line_cost> lines;
+        QUICKBOOK_FOR (line_cost const& x, files) {
+            std::vector<line_cost>& l = file_lines[x.file];
+            std::stable_sort(l.begin(), l.end(), more_expensive);
+            if (top_n && l.size() > top_n) l.resize(top_n);
+            lines.insert(lines.end(), l.begin(), l.end());
+        }
+
+        switch (fmt) {
+        case text:
+            write_text(out, files, lines);
+            break;
+        case json:
+            write_json(out, files, lines);
+            break;
+        default:
+            assert(false);
+        }
+    }
+}
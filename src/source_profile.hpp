@@ -0,0 +1,103 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#if !defined(QUICKBOOK_SOURCE_PROFILE_HPP)
+#define QUICKBOOK_SOURCE_PROFILE_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <iosfwd>
+#include <map>
+#include <set>
+#include <vector>
+#include <boost/filesystem/path.hpp>
+#include "files.hpp"
+#include "string_view.hpp"
+
+namespace quickbook
+{
+    namespace fs = boost::filesystem;
+
+    // Attributes the time spent parsing and expanding the source, and the
+    // amount of output generated, to the lines of source that caused it.
+    //
+    // Each measured range is started with 'start' and then finished with
+    // either 'stop' or 'cancel'. Ranges can be nested, and the cost
+    // recorded for a range excludes the cost of any ranges stopped inside
+    // it. A cancelled range (e.g. for an element that failed to parse) is
+    // charged to its parent.
+
+    struct source_profiler
+    {
+        enum format
+        {
+            text,
+            json
+        };
+
+        source_profiler();
+
+        bool enabled() const { return enabled_; }
+        void enable() { enabled_ = true; }
+
+        void start(std::size_t output_size);
+        void stop(
+            file_ptr const&,
+            string_iterator first,
+            string_iterator last,
+            std::size_t output_size);
+        void cancel();
+
+        // Writes the totals for each file, and the 'top_n' most expensive
+        // line ranges in each file, or all of them if 'top_n' is zero.
+        void write_report(fs::path const&, format, unsigned top_n);
+        void write_report(std::ostream&, format, unsigned top_n);
+
+      private:
+        typedef std::chrono::steady_clock clock;
+
+        struct frame
+        {
+            clock::time_point start;
+            std::size_t output_size;
+            clock::duration child_time;
+            std::ptrdiff_t child_output;
+        };
+
+        struct range_key
+        {
+            file* f;
+            std::size_t begin;
+            std::size_t end;
+
+            bool operator<(range_key const& x) const
+            {
+                return f != x.f ? f < x.f
+                                : begin != x.begin ? begin < x.begin
+                                                   : end < x.end;
+            }
+        };
+
+        struct range_cost
+        {
+            range_cost() : time(), output(0), count(0) {}
+
+            clock::duration time;
+            std::ptrdiff_t output;
+            unsigned count;
+        };
+
+        bool enabled_;
+        std::vector<frame> frames_;
+        std::map<range_key, range_cost> ranges_;
+        // Keeps the files alive, so that the keys remain valid.
+        std::set<file_ptr> files_;
+    };
+}
+
+#endif
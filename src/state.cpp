@@ -9,6 +9,7 @@
     http://www.boost.org/LICENSE_1_0.txt)
 =============================================================================*/
 #include "state.hpp"
+#include <cassert>
 #include "document_state.hpp"
 #include "for.hpp"
 #include "grammar.hpp"
@@ -50,9 +51,15 @@ namespace quickbook
         , dependencies()
         , explicit_list(false)
         , strict_mode(false)
+        , profiler()
+        , include_cache_dir()
+        , time_dependent_output(0)
+        , paragraph_count(0)
+        , last_revisions()
 
         , imported(false)
         , macro()
+        , macro_fingerprint()
         , source_mode()
         , source_mode_next()
         , source_mode_next_pos()
@@ -105,6 +112,12 @@ namespace quickbook
         in_list_save.pop();
     }
 
+    std::size_t state::output_size() const
+    {
+        assert(profiler.enabled());
+        return out.str().size() + phrase.str().size();
+    }
+
     source_mode_info state::tagged_source_mode() const
     {
         source_mode_info result;
@@ -156,10 +169,14 @@ namespace quickbook
         , xinclude_base(state.xinclude_base)
         , source_mode(state.source_mode)
         , macro()
+        , macro_fingerprint()
         , template_depth(state.template_depth)
         , min_section_level(state.min_section_level)
     {
-        if (scope & scope_macros) macro = state.macro;
+        if (scope & scope_macros) {
+            macro = state.macro;
+            macro_fingerprint = state.macro_fingerprint;
+        }
         if (scope & scope_templates) state.templates.push();
         if (scope & scope_output) {
             state.push_output();
@@ -180,7 +197,10 @@ namespace quickbook
             state.pop_output();
         }
         if (scope & scope_templates) state.templates.pop();
-        if (scope & scope_macros) state.macro = macro;
+        if (scope & scope_macros) {
+            state.macro = macro;
+            state.macro_fingerprint = macro_fingerprint;
+        }
         boost::core::invoke_swap(state.template_depth, template_depth);
         boost::core::invoke_swap(state.min_section_level, min_section_level);
     }
@@ -11,11 +11,14 @@
 #define BOOST_SPIRIT_ACTIONS_CLASS_HPP
 
 #include <map>
+#include <stack>
 #include <boost/scoped_ptr.hpp>
 #include "collector.hpp"
 #include "dependency_tracker.hpp"
+#include "fingerprint.hpp"
 #include "include_paths.hpp"
 #include "parsers.hpp"
+#include "source_profile.hpp"
 #include "symbols.hpp"
 #include "syntax_highlight.hpp"
 #include "template_stack.hpp"
@@ -60,10 +63,17 @@ namespace quickbook
         dependency_tracker dependencies;
         bool explicit_list; // set when using a list
         bool strict_mode;
+        source_profiler profiler;
+        fs::path include_cache_dir; // Empty if not caching included files.
+        int time_dependent_output;  // Dates or times written to the output.
+        unsigned paragraph_count;   // Calls to paragraph_action.
+        // Output positions where the default last revision was written.
+        std::vector<std::size_t> last_revisions;
 
         // state saved for files and templates.
         bool imported;
         string_symbols macro;
+        fingerprint macro_fingerprint; // Of macros defined in the document.
         source_mode_info source_mode;
         source_mode_type source_mode_next;
         value source_mode_next_pos;
@@ -97,6 +107,11 @@ namespace quickbook
         void push_output();
         void pop_output();
 
+        // Size of the current output, for measuring how much output is
+        // generated by part of the source. This flushes the output
+        // streams, so it's only used when the profiler is enabled.
+        std::size_t output_size() const;
+
         void start_list(char mark);
         void end_list(char mark);
         void start_list_item();
@@ -43,6 +43,7 @@ namespace quickbook
         fs::path xinclude_base;
         source_mode_info source_mode;
         string_symbols macro;
+        fingerprint macro_fingerprint;
         int template_depth;
         int min_section_level;
 
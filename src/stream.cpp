@@ -7,6 +7,9 @@
 =============================================================================*/
 
 #include "stream.hpp"
+#include <sstream>
+#include <utility>
+#include <vector>
 #include "files.hpp"
 #include "path.hpp"
 
@@ -21,10 +24,108 @@ namespace quickbook
     {
         namespace
         {
-            bool ms_errors = false;
+            unsigned diagnostics = 0;
+
+            inline diagnostic_sink& sink()
+            {
+                static diagnostic_sink x;
+                return x;
+            }
+
+            // The diagnostic that's currently being written. It's added to
+            // the sink when the next one is started, or when the
+            // diagnostics are flushed.
+            struct pending_diagnostic
+            {
+                bool active;
+                diagnostic_sink::severity type;
+                fs::path file;
+                std::ptrdiff_t line;
+                diagnostic_sink::site expanded_from;
+                std::basic_ostringstream<stream_string::value_type> buffer;
+                ostream message;
+
+                pending_diagnostic()
+                    : active(false)
+                    , type(diagnostic_sink::error)
+                    , file()
+                    , line(-1)
+                    , expanded_from()
+                    , buffer()
+                    , message(buffer)
+                {
+                }
+            };
+
+            inline pending_diagnostic& pending()
+            {
+                static pending_diagnostic x;
+                return x;
+            }
+
+            typedef std::vector<std::pair<file_ptr, string_iterator> >
+                expansion_stack;
+
+            inline expansion_stack& expansions()
+            {
+                static expansion_stack x;
+                return x;
+            }
+
+            void add_pending_diagnostic()
+            {
+                pending_diagnostic& p = pending();
+                if (p.active) {
+                    sink().add(
+                        p.type, p.file, p.line, p.buffer.str(),
+                        p.expanded_from);
+                    p.active = false;
+                }
+            }
+
+            ostream& start_diagnostic(
+                diagnostic_sink::severity type,
+                fs::path const& file,
+                std::ptrdiff_t line)
+            {
+                if (type != diagnostic_sink::summary) ++diagnostics;
+                add_pending_diagnostic();
+
+                pending_diagnostic& p = pending();
+                p.active = true;
+                p.type = type;
+                p.file = file;
+                p.line = line;
+                p.expanded_from = diagnostic_sink::site();
+                if (!expansions().empty()) {
+                    file_ptr const& f = expansions().back().first;
+                    p.expanded_from = diagnostic_sink::site(
+                        f->path,
+                        f->position_of(expansions().back().second).line);
+                }
+                p.buffer.str(stream_string());
+                p.buffer.clear();
+                return p.message;
+            }
+        }
+
+        void set_ms_errors(bool x) { sink().ms_errors = x; }
+
+        void set_max_diagnostics(unsigned x) { sink().max_diagnostics = x; }
+
+        void set_diagnostics_format(diagnostic_sink::format x)
+        {
+            sink().output_format = x;
         }
 
-        void set_ms_errors(bool x) { ms_errors = x; }
+        unsigned diagnostic_count() { return diagnostics; }
+
+        expansion_site::expansion_site(file_ptr const& f, string_iterator pos)
+        {
+            expansions().push_back(std::make_pair(f, pos));
+        }
+
+        expansion_site::~expansion_site() { expansions().pop_back(); }
 
 #if QUICKBOOK_WIDE_STREAMS
 
@@ -80,21 +181,14 @@ namespace quickbook
 
 #endif
 
-        ostream& outerr() { return error_stream() << "Error: "; }
+        ostream& outerr()
+        {
+            return start_diagnostic(diagnostic_sink::error, fs::path(), -1);
+        }
 
         ostream& outerr(fs::path const& file, std::ptrdiff_t line)
         {
-            if (line >= 0) {
-                if (ms_errors)
-                    return error_stream() << path_to_stream(file) << "(" << line
-                                          << "): error: ";
-                else
-                    return error_stream() << path_to_stream(file) << ":" << line
-                                          << ": error: ";
-            }
-            else {
-                return error_stream() << path_to_stream(file) << ": error: ";
-            }
+            return start_diagnostic(diagnostic_sink::error, file, line);
         }
 
         ostream& outerr(file_ptr const& f, string_iterator pos)
@@ -104,17 +198,7 @@ namespace quickbook
 
         ostream& outwarn(fs::path const& file, std::ptrdiff_t line)
         {
-            if (line >= 0) {
-                if (ms_errors)
-                    return error_stream() << path_to_stream(file) << "(" << line
-                                          << "): warning: ";
-                else
-                    return error_stream() << path_to_stream(file) << ":" << line
-                                          << ": warning: ";
-            }
-            else {
-                return error_stream() << path_to_stream(file) << ": warning: ";
-            }
+            return start_diagnostic(diagnostic_sink::warning, file, line);
         }
 
         ostream& outwarn(file_ptr const& f, string_iterator pos)
@@ -122,6 +206,23 @@ namespace quickbook
             return outwarn(f->path, f->position_of(pos).line);
         }
 
+        ostream& outsummary()
+        {
+            return start_diagnostic(diagnostic_sink::summary, fs::path(), -1);
+        }
+
+        void flush_diagnostics()
+        {
+            add_pending_diagnostic();
+            if (!sink().empty()) sink().write(error_stream().base);
+        }
+
+        void finish_diagnostics()
+        {
+            add_pending_diagnostic();
+            sink().finish(error_stream().base);
+        }
+
         ostream& ostream::operator<<(char c)
         {
             assert(c && !(c & 0x80));
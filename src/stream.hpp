@@ -13,6 +13,7 @@
 
 #include <iostream>
 #include <boost/filesystem/path.hpp>
+#include "diagnostics.hpp"
 #include "native_text.hpp"
 
 namespace quickbook
@@ -73,12 +74,43 @@ namespace quickbook
         // common IDEs. Set 'ms_errors' to determine if VS format
         // or GCC format. Returns the stream to continue ouput of the verbose
         // error message.
+        //
+        // The messages are collected in a diagnostic_sink, so that repeated
+        // messages are only written once. 'flush_diagnostics' writes them
+        // out after each stage, and 'finish_diagnostics' when a run is
+        // finished.
         void set_ms_errors(bool);
+        void set_max_diagnostics(unsigned);
+        void set_diagnostics_format(diagnostic_sink::format);
         ostream& outerr();
         ostream& outerr(fs::path const& file, std::ptrdiff_t line = -1);
         ostream& outwarn(fs::path const& file, std::ptrdiff_t line = -1);
         ostream& outerr(file_ptr const&, string_iterator);
         ostream& outwarn(file_ptr const&, string_iterator);
+
+        // Writes a message about the whole run, such as the error count.
+        // It isn't limited by 'set_max_diagnostics', or included in
+        // 'diagnostic_count'.
+        ostream& outsummary();
+
+        void flush_diagnostics();
+        void finish_diagnostics();
+
+        // The number of errors and warnings written so far, including
+        // repeated ones.
+        unsigned diagnostic_count();
+
+        // Marks a template call while it's being expanded, so that
+        // diagnostics from the template can say where they came from.
+        struct expansion_site
+        {
+            expansion_site(file_ptr const&, string_iterator);
+            ~expansion_site();
+
+          private:
+            expansion_site(expansion_site const&);
+            expansion_site& operator=(expansion_site const&);
+        };
     }
 }
 
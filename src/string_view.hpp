@@ -28,6 +28,12 @@ namespace quickbook
         string_view(const char* x) : base(x) {}
         string_view(const char* x, base::size_type len) : base(x, len) {}
 
+        string_view& operator=(string_view const& x)
+        {
+            base::operator=(x);
+            return *this;
+        }
+
         std::string to_s() const { return std::string(begin(), end()); }
     };
 
@@ -33,41 +33,59 @@ namespace quickbook
             content.get_tag() == template_tags::snippet);
     }
 
+    template_symbol const* template_scope::find(
+        std::string const& identifier) const
+    {
+        for (std::size_t i = 0; i < arg_count; ++i) {
+            if (args[i].identifier == identifier) return &args[i];
+        }
+
+        return boost::spirit::classic::find(symbols, identifier.c_str());
+    }
+
     template_stack::template_stack()
-        : scope(template_stack::parser(*this)), scopes(), parent_1_4(0)
+        : scope(template_stack::parser(*this))
+        , storage()
+        , scopes()
+        , free_scopes()
+        , parent_1_4(0)
+        , next_id(1)
+        , record_boundary(0)
+        , found()
     {
-        scopes.push_front(template_scope());
-        parent_1_4 = &scopes.front();
+        parent_1_4 = &new_scope();
     }
 
-    template_symbol* template_stack::find(std::string const& symbol) const
+    template_symbol const* template_stack::find(
+        std::string const& symbol) const
     {
-        for (template_scope const* i = &*scopes.begin(); i;
-             i = i->parent_scope) {
-            if (template_symbol* ts =
-                    boost::spirit::classic::find(i->symbols, symbol.c_str()))
+        for (template_scope const* i = scopes.back(); i; i = i->parent_scope) {
+            if (template_symbol const* ts = i->find(symbol)) {
+                if (i->id < record_boundary) {
+                    found.push_back(std::make_pair(ts, i->id));
+                }
                 return ts;
+            }
         }
         return 0;
     }
 
-    template_symbol* template_stack::find_top_scope(
+    template_symbol const* template_stack::find_top_scope(
         std::string const& symbol) const
     {
-        return boost::spirit::classic::find(
-            scopes.front().symbols, symbol.c_str());
+        return scopes.back()->find(symbol);
     }
 
     template_symbols const& template_stack::top() const
     {
         BOOST_ASSERT(!scopes.empty());
-        return scopes.front().symbols;
+        return scopes.back()->symbols;
     }
 
     template_scope const& template_stack::top_scope() const
     {
         BOOST_ASSERT(!scopes.empty());
-        return scopes.front();
+        return *scopes.back();
     }
 
     bool template_stack::add(template_symbol const& ts)
@@ -79,25 +97,118 @@ namespace quickbook
             return false;
         }
 
-        boost::spirit::classic::add(
-            scopes.front().symbols, ts.identifier.c_str(), ts);
+        template_scope& top = *scopes.back();
+        boost::spirit::classic::add(top.symbols, ts.identifier.c_str(), ts);
+        top.has_symbols = true;
+        top.names.add(ts.identifier);
 
         return true;
     }
 
+    bool template_stack::add_arguments(
+        std::vector<std::string> const& params,
+        std::vector<value> const& args,
+        template_scope const* lexical_parent)
+    {
+        BOOST_ASSERT(!scopes.empty());
+        BOOST_ASSERT(lexical_parent);
+        BOOST_ASSERT(args.size() <= params.size());
+
+        template_scope& top = *scopes.back();
+
+        for (std::size_t i = 0; i < args.size(); ++i) {
+            if (this->find_top_scope(params[i])) {
+                return false;
+            }
+
+            if (top.arg_count < top.args.size()) {
+                // Reuse an argument from an earlier call, which will usually
+                // have enough space for the identifier.
+                template_symbol& arg = top.args[top.arg_count];
+                arg.identifier = params[i];
+                arg.content = args[i];
+                arg.lexical_parent = lexical_parent;
+            }
+            else {
+                top.args.push_back(template_symbol(
+                    params[i], std::vector<std::string>(), args[i],
+                    lexical_parent));
+                top.expansions.push_back(argument_expansion());
+            }
+
+            ++top.arg_count;
+            top.names.add(params[i]);
+        }
+
+        return true;
+    }
+
+    template_scope& template_stack::new_scope()
+    {
+        template_scope* result;
+
+        if (free_scopes.empty()) {
+            storage.push_back(template_scope());
+            result = &storage.back();
+        }
+        else {
+            result = free_scopes.back();
+            free_scopes.pop_back();
+        }
+
+        result->id = next_id++;
+        scopes.push_back(result);
+        return *result;
+    }
+
     void template_stack::push()
     {
-        template_scope const& old_front = scopes.front();
-        scopes.push_front(template_scope());
-        scopes.front().parent_1_4 = parent_1_4;
-        scopes.front().parent_scope = &old_front;
-        parent_1_4 = &scopes.front();
+        template_scope const* old_front = scopes.back();
+        template_scope& front = new_scope();
+        front.parent_1_4 = parent_1_4;
+        front.parent_scope = old_front;
+        parent_1_4 = &front;
     }
 
     void template_stack::pop()
     {
-        parent_1_4 = scopes.front().parent_1_4;
-        scopes.pop_front();
+        BOOST_ASSERT(scopes.size() > 1);
+
+        template_scope& front = *scopes.back();
+        parent_1_4 = front.parent_1_4;
+        scopes.pop_back();
+
+        // Clear the scope so that it can be reused, but keep the memory
+        // allocated for the arguments.
+        if (front.has_symbols) {
+            front.symbols = template_symbols();
+            front.has_symbols = false;
+        }
+
+        for (std::size_t i = 0; i < front.arg_count; ++i) {
+            front.args[i].content = value();
+            front.args[i].lexical_parent = 0;
+            front.expansions[i].stored = false;
+            front.expansions[i].output.clear();
+        }
+
+        front.arg_count = 0;
+        front.parent_scope = 0;
+        front.parent_1_4 = 0;
+        front.names = fingerprint();
+        free_scopes.push_back(&front);
+    }
+
+    argument_expansion* template_stack::find_expansion(
+        template_symbol const* symbol)
+    {
+        BOOST_ASSERT(!scopes.empty());
+
+        template_scope& top = *scopes.back();
+        for (std::size_t i = 0; i < top.arg_count; ++i) {
+            if (&top.args[i] == symbol) return &top.expansions[i];
+        }
+        return 0;
     }
 
     void template_stack::start_template(template_symbol const* symbol)
@@ -106,12 +217,46 @@ namespace quickbook
         //                 current scope (the dynamic scope).
         // Quickbook 1.5+: Use the scope the template was defined in
         //                 (the static scope).
+        template_scope& front = *scopes.back();
+
         if (symbol->content.get_file()->version() >= 105u) {
-            parent_1_4 = scopes.front().parent_1_4;
-            scopes.front().parent_scope = symbol->lexical_parent;
+            parent_1_4 = front.parent_1_4;
+            front.parent_scope = symbol->lexical_parent;
         }
         else {
-            scopes.front().parent_scope = scopes.front().parent_1_4;
+            front.parent_scope = front.parent_1_4;
+        }
+    }
+
+    template_stack::recording template_stack::start_recording()
+    {
+        recording r = {found.size(), next_id, record_boundary};
+        record_boundary = next_id;
+        return r;
+    }
+
+    void template_stack::stop_recording(recording const& r)
+    {
+        record_boundary = r.previous_boundary;
+        if (!record_boundary) found.clear();
+    }
+
+    void template_stack::recorded_templates(
+        recording const& r, std::vector<template_symbol const*>& result) const
+    {
+        for (std::size_t i = r.start; i < found.size(); ++i) {
+            if (found[i].second < r.boundary) {
+                result.push_back(found[i].first);
+            }
+        }
+    }
+
+    fingerprint template_stack::visible_names() const
+    {
+        fingerprint result;
+        for (template_scope const* i = scopes.back(); i; i = i->parent_scope) {
+            result.add(i->names.value());
         }
+        return result;
     }
 }
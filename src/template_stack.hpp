@@ -19,6 +19,7 @@
 #include <boost/spirit/include/classic_functor_parser.hpp>
 #include <boost/spirit/include/classic_symbols.hpp>
 #include <boost/tuple/tuple.hpp>
+#include "fingerprint.hpp"
 #include "fwd.hpp"
 #include "template_tags.hpp"
 #include "values.hpp"
@@ -46,6 +47,32 @@ namespace quickbook
 
     typedef boost::spirit::classic::symbols<template_symbol> template_symbols;
 
+    // argument expansion
+    //
+    // The output of a template argument, so that an argument which is used
+    // several times in a template body only needs to be expanded once. It's
+    // only stored if expanding the argument didn't change anything apart
+    // from the output, and is only reused if the context that could change
+    // the output is the same.
+
+    struct argument_expansion
+    {
+        argument_expansion()
+            : stored(false)
+            , source_mode()
+            , source_mode_next()
+            , macros()
+            , output()
+        {
+        }
+
+        bool stored;
+        source_mode_type source_mode;
+        source_mode_type source_mode_next;
+        fingerprint::value_type macros;
+        std::string output;
+    };
+
     // template scope
     //
     // 1.4-: parent_scope is the previous scope on the dynamic
@@ -57,13 +84,43 @@ namespace quickbook
     // correct lookup chain for that version of quickboook.
     //
     // symbols contains the templates defined in this scope.
+    //
+    // args contains the arguments of a template call. They're looked up by
+    // comparing with their identifiers, rather than being added to symbols,
+    // so that binding them doesn't allocate once the scope has been used a
+    // few times. Only the first arg_count are in use. expansions has the
+    // stored expansion of each argument.
+    //
+    // id is a number which increases with each new scope, and names is a
+    // fingerprint of the identifiers added to the scope, in order. These
+    // are used to cache included files.
 
     struct template_scope
     {
-        template_scope() : parent_scope(), parent_1_4() {}
+        template_scope()
+            : parent_scope()
+            , parent_1_4()
+            , symbols()
+            , has_symbols(false)
+            , args()
+            , expansions()
+            , arg_count(0)
+            , id(0)
+            , names()
+        {
+        }
+
+        template_symbol const* find(std::string const&) const;
+
         template_scope const* parent_scope;
         template_scope const* parent_1_4;
         template_symbols symbols;
+        bool has_symbols;
+        std::vector<template_symbol> args;
+        std::vector<argument_expansion> expansions;
+        std::size_t arg_count;
+        unsigned id;
+        fingerprint names;
     };
 
     struct template_stack
@@ -82,16 +139,35 @@ namespace quickbook
                 // search all scopes for the longest matching symbol.
                 typename Scanner::iterator_t f = scan.first;
                 std::ptrdiff_t len = -1;
-                for (template_scope const* i = &*ts.scopes.begin(); i;
+                for (template_scope const* i = ts.scopes.back(); i;
                      i = i->parent_scope) {
                     boost::spirit::classic::match<> m = i->symbols.parse(scan);
                     if (m.length() > len) len = m.length();
                     scan.first = f;
+
+                    for (std::size_t a = 0; a < i->arg_count; ++a) {
+                        std::ptrdiff_t n =
+                            match_prefix(f, scan.last, i->args[a].identifier);
+                        if (n > len) len = n;
+                    }
                 }
                 if (len >= 0) scan.first = boost::next(f, len);
                 return len;
             }
 
+            // Match an identifier at the start of the input, in the same
+            // way as the symbol table.
+            template <typename Iterator>
+            static std::ptrdiff_t match_prefix(
+                Iterator first, Iterator last, std::string const& identifier)
+            {
+                for (std::string::const_iterator it = identifier.begin();
+                     it != identifier.end(); ++it, ++first) {
+                    if (first == last || *first != *it) return -1;
+                }
+                return static_cast<std::ptrdiff_t>(identifier.size());
+            }
+
             template_stack& ts;
 
           private:
@@ -99,25 +175,70 @@ namespace quickbook
         };
 
         template_stack();
-        template_symbol* find(std::string const& symbol) const;
-        template_symbol* find_top_scope(std::string const& symbol) const;
+        template_symbol const* find(std::string const& symbol) const;
+        template_symbol const* find_top_scope(std::string const& symbol) const;
         template_symbols const& top() const;
         template_scope const& top_scope() const;
         // Add the given template symbol to the current scope.
         // If it doesn't have a scope, sets the symbol's scope to the current
         // scope.
         bool add(template_symbol const&);
+        // Add the arguments of a template call to the current scope, bound
+        // to the corresponding parameter names. Returns false if a name is
+        // already in use.
+        bool add_arguments(
+            std::vector<std::string> const& params,
+            std::vector<value> const& args,
+            template_scope const* lexical_parent);
         void push();
         void pop();
 
+        // The stored expansion for an argument of the current scope, or null
+        // if the symbol isn't one of its arguments.
+        argument_expansion* find_expansion(template_symbol const*);
+
         void start_template(template_symbol const*);
 
+        // Record the templates found in scopes that exist when recording
+        // starts, i.e. the templates inherited by the code that follows.
+        // Recordings can be nested.
+        struct recording
+        {
+            std::size_t start;
+            unsigned boundary;
+            unsigned previous_boundary;
+        };
+
+        recording start_recording();
+        bool is_recording() const { return record_boundary != 0; }
+        void stop_recording(recording const&);
+        void recorded_templates(
+            recording const&, std::vector<template_symbol const*>&) const;
+
+        // Fingerprint of the names that are visible from the current scope.
+        fingerprint visible_names() const;
+
         boost::spirit::classic::functor_parser<parser> scope;
 
       private:
         friend struct parser;
-        deque scopes;
+
+        template_scope& new_scope();
+
+        // Every scope that's been created, scopes is the current stack,
+        // with the top scope at the back, and free_scopes are the scopes
+        // that have been popped, to be reused.
+        deque storage;
+        std::vector<template_scope*> scopes;
+        std::vector<template_scope*> free_scopes;
         template_scope const* parent_1_4;
+        unsigned next_id;
+
+        // Templates found while recording, along with the id of the scope
+        // they were found in.
+        unsigned record_boundary;
+        mutable std::vector<std::pair<template_symbol const*, unsigned> >
+            found;
 
         template_stack& operator=(template_stack const&);
     };
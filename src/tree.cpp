@@ -190,6 +190,24 @@ namespace quickbook
             current_ = n;
         }
 
+        void tree_builder_base::add_elements(tree_base* t)
+        {
+            tree_node_base* n = t->root_;
+            t->root_ = 0;
+            if (!n) {
+                return;
+            }
+
+            assert(!n->parent_ && !n->prev_);
+            add_element(n);
+            while (n->next_) {
+                n = n->next_;
+                assert(!n->parent_);
+                n->parent_ = parent_;
+            }
+            current_ = n;
+        }
+
         void tree_builder_base::start_children()
         {
             parent_ = current_;
@@ -75,6 +75,7 @@ namespace quickbook
         struct tree_base
         {
             friend struct tree_node_base;
+            friend struct tree_builder_base;
 
           private:
             tree_base(tree_base const&);
@@ -129,6 +130,7 @@ namespace quickbook
             tree_node_base* extract(tree_node_base*);
             tree_node_base* release();
             void add_element(tree_node_base* n);
+            void add_elements(tree_base*);
 
           public:
             void start_children();
@@ -160,6 +162,11 @@ namespace quickbook
                 return tree<T>(static_cast<T*>(tree_builder_base::release()));
             }
             void add_element(T* n) { tree_builder_base::add_element(n); }
+            // Add a tree, and its siblings, after the current element.
+            void add_elements(tree<T>&& x)
+            {
+                tree_builder_base::add_elements(&x);
+            }
         };
     }
 }
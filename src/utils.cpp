@@ -217,5 +217,44 @@ namespace quickbook
         {
             return escape_uri_impl(uri_param, "-_.!~*'()?\\/:&=#%+");
         }
+
+        std::string escape_json(quickbook::string_view str)
+        {
+            static char const* hex = "0123456789abcdef";
+
+            std::string result;
+            result.reserve(str.size());
+
+            for (string_iterator it = str.begin(); it != str.end(); ++it) {
+                unsigned char c = static_cast<unsigned char>(*it);
+
+                switch (c) {
+                case '"':
+                    result += "\\\"";
+                    break;
+                case '\\':
+                    result += "\\\\";
+                    break;
+                case '\n':
+                    result += "\\n";
+                    break;
+                case '\t':
+                    result += "\\t";
+                    break;
+                default:
+                    if (c < 0x20) {
+                        result += "\\u00";
+                        result += hex[c >> 4];
+                        result += hex[c & 0xf];
+                    }
+                    else {
+                        result += *it;
+                    }
+                    break;
+                }
+            }
+
+            return result;
+        }
     }
 }
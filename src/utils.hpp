@@ -30,6 +30,9 @@ namespace quickbook
         // URI escape string, leaving characters generally used in URIs.
         std::string partially_escape_uri(quickbook::string_view);
 
+        // Escape a string for use in a JSON string literal.
+        std::string escape_json(quickbook::string_view);
+
         // Defined in id_xml.cpp. Just because.
         std::string linkify(
             quickbook::string_view source, quickbook::string_view linkend);
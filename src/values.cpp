@@ -732,6 +732,21 @@ namespace quickbook
             return r;
         }
 
+        void value_list_builder::save(value_node*& head, value_node**& back)
+        {
+            head = head_;
+            back = back_ == &head_ ? 0 : back_;
+            head_ = &value_list_end_impl::instance;
+            back_ = &head_;
+        }
+
+        void value_list_builder::restore(value_node* head, value_node** back)
+        {
+            list_unref(head_);
+            head_ = head;
+            back_ = back ? back : &head_;
+        }
+
         void value_list_builder::append(value_node* item)
         {
             if (item->next_) item = item->clone();
@@ -761,6 +776,12 @@ namespace quickbook
     {
     }
 
+    value_builder::~value_builder()
+    {
+        while (!saved.empty())
+            restore();
+    }
+
     void value_builder::swap(value_builder& other)
     {
         current.swap(other.current);
@@ -770,16 +791,19 @@ namespace quickbook
 
     void value_builder::save()
     {
-        boost::scoped_ptr<value_builder> store(new value_builder);
-        swap(*store);
-        saved.swap(store);
+        saved_list s = {0, 0, list_tag};
+        current.save(s.head, s.back);
+        saved.push_back(s);
+        list_tag = value::default_tag;
     }
 
     void value_builder::restore()
     {
-        boost::scoped_ptr<value_builder> store;
-        store.swap(saved);
-        swap(*store);
+        assert(!saved.empty());
+        saved_list const& s = saved.back();
+        current.restore(s.head, s.back);
+        list_tag = s.tag;
+        saved.pop_back();
     }
 
     value value_builder::release()
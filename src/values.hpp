@@ -15,9 +15,9 @@
 #include <stdexcept>
 #include <string>
 #include <utility>
+#include <vector>
 #include <boost/iterator/iterator_traits.hpp>
 #include <boost/operators.hpp>
-#include <boost/scoped_ptr.hpp>
 #include "files.hpp"
 #include "fwd.hpp"
 #include "string_view.hpp"
@@ -233,6 +233,12 @@ namespace quickbook
             void swap(value_list_builder& b);
             value_node* release();
 
+            // Move the list into a saved entry, leaving the builder empty,
+            // and replace the current list with a saved entry. Used for
+            // value_builder's stack, so that saving doesn't allocate.
+            void save(value_node*& head, value_node**& back);
+            void restore(value_node* head, value_node** back);
+
             void append(value_node*);
             void sort();
 
@@ -297,6 +303,7 @@ namespace quickbook
     {
       public:
         value_builder();
+        ~value_builder();
         void swap(value_builder& b);
 
         void save();
@@ -315,9 +322,22 @@ namespace quickbook
         bool empty() const;
 
       private:
+        value_builder(value_builder const&);
+        value_builder& operator=(value_builder const&);
+
+        // The saved lists are kept in a single vector, so once it's grown
+        // to the maximum nesting depth, saving and restoring the builder
+        // doesn't allocate.
+        struct saved_list
+        {
+            detail::value_node* head;
+            detail::value_node** back;
+            value::tag_type tag;
+        };
+
         detail::value_list_builder current;
         value::tag_type list_tag;
-        boost::scoped_ptr<value_builder> saved;
+        std::vector<saved_list> saved;
     };
 
     ////////////////////////////////////////////////////////////////////////////
@@ -7,6 +7,12 @@ http://www.boost.org/LICENSE_1_0.txt)
 =============================================================================*/
 
 #include "xml_parse.hpp"
+#include <algorithm>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include "for.hpp"
 #include "simple_parse.hpp"
 #include "stream.hpp"
 #include "utils.hpp"
@@ -81,12 +87,149 @@ namespace quickbook
         quickbook::string_view read_string(
             string_iterator& it, string_iterator end);
 
+        bool parse_chunks(
+            xml_tree&,
+            quickbook::string_view,
+            std::size_t chunk_size,
+            unsigned threads);
+        void parse_range(
+            xml_tree_builder&, string_iterator begin, string_iterator end);
+        bool scan_root_children(
+            std::vector<string_iterator>& boundaries,
+            string_iterator begin,
+            string_iterator end);
+        bool skip_tag(string_iterator& it, string_iterator end);
+        bool self_closing(string_iterator start, string_iterator end);
+        bool skip_string(string_iterator& it, string_iterator end);
+
+        // The minimum amount of the document to parse in each thread.
+        std::size_t const default_chunk_size = 1024 * 1024;
+
         xml_tree xml_parse(quickbook::string_view source)
         {
-            typedef string_iterator iterator;
-            iterator it = source.begin(), end = source.end();
+            return xml_parse(
+                source, default_chunk_size,
+                std::thread::hardware_concurrency());
+        }
 
-            xml_tree_builder builder;
+        // Large documents are parsed by splitting the root element's children
+        // into chunks and parsing each chunk in its own thread. The chunks
+        // are found by a quick scan, which only tracks the depth of the
+        // elements and doesn't check that they're valid, so if anything goes
+        // wrong, the document is parsed again in a single thread to get the
+        // correct error.
+
+        xml_tree xml_parse(
+            quickbook::string_view source,
+            std::size_t chunk_size,
+            unsigned threads)
+        {
+            xml_tree tree;
+            if (!parse_chunks(tree, source, chunk_size, threads)) {
+                xml_tree_builder builder;
+                parse_range(builder, source.begin(), source.end());
+                tree = builder.release();
+            }
+            return tree;
+        }
+
+        bool parse_chunks(
+            xml_tree& tree,
+            quickbook::string_view source,
+            std::size_t chunk_size,
+            unsigned threads)
+        {
+            if (threads < 2 || source.size() / 2 < chunk_size) {
+                return false;
+            }
+
+            std::vector<string_iterator> boundaries;
+            if (!scan_root_children(boundaries, source.begin(), source.end())) {
+                return false;
+            }
+
+            // Group the children into chunks.
+            std::size_t content_size = boundaries.back() - boundaries.front();
+            chunk_size = (std::max)(chunk_size, content_size / threads);
+            std::vector<string_iterator> chunks;
+            chunks.push_back(boundaries.front());
+            for (auto it = boundaries.begin() + 1; it != boundaries.end();
+                 ++it) {
+                if (std::size_t(*it - chunks.back()) >= chunk_size ||
+                    it + 1 == boundaries.end()) {
+                    chunks.push_back(*it);
+                }
+            }
+            if (chunks.size() < 3) {
+                return false;
+            }
+
+            std::vector<xml_tree> results(chunks.size() - 1);
+            std::vector<char> failed(chunks.size() - 1, false);
+            std::vector<std::exception_ptr> exceptions(chunks.size() - 1);
+
+            auto parse_chunk = [&](std::size_t i) {
+                try {
+                    xml_tree_builder builder;
+                    parse_range(builder, chunks[i], chunks[i + 1]);
+                    // A chunk should only contain complete elements.
+                    failed[i] = builder.parent() != 0;
+                    results[i] = builder.release();
+                } catch (xml_parse_error&) {
+                    failed[i] = true;
+                } catch (...) {
+                    exceptions[i] = std::current_exception();
+                }
+            };
+
+            // If a thread can't be started, fall back to the serial parse.
+            std::vector<std::thread> workers;
+            workers.reserve(results.size() - 1);
+            try {
+                for (std::size_t i = 1; i < results.size(); ++i) {
+                    workers.push_back(std::thread(parse_chunk, i));
+                }
+            } catch (std::system_error&) {
+                QUICKBOOK_FOR (auto& worker, workers) {
+                    worker.join();
+                }
+                return false;
+            }
+            parse_chunk(0);
+            QUICKBOOK_FOR (auto& worker, workers) {
+                worker.join();
+            }
+
+            for (std::size_t i = 0; i < results.size(); ++i) {
+                if (exceptions[i]) {
+                    std::rethrow_exception(exceptions[i]);
+                }
+                if (failed[i]) {
+                    return false;
+                }
+            }
+
+            try {
+                xml_tree_builder builder;
+                parse_range(builder, source.begin(), chunks.front());
+                QUICKBOOK_FOR (auto& result, results) {
+                    builder.add_elements(std::move(result));
+                }
+                parse_range(builder, chunks.back(), source.end());
+                tree = builder.release();
+                return true;
+            } catch (xml_parse_error&) {
+                return false;
+            }
+        }
+
+        void parse_range(
+            xml_tree_builder& builder,
+            string_iterator begin,
+            string_iterator end)
+        {
+            typedef string_iterator iterator;
+            iterator it = begin;
 
             while (true) {
                 iterator start = it;
@@ -119,8 +262,127 @@ namespace quickbook
                     break;
                 }
             }
+        }
+
+        // Find the start of the root element's contents, the end of each of
+        // its child elements, and the start of its close tag.
+
+        bool scan_root_children(
+            std::vector<string_iterator>& boundaries,
+            string_iterator begin,
+            string_iterator end)
+        {
+            string_iterator it = begin;
+            unsigned depth = 0;
+
+            while (true) {
+                read_to(it, end, '<');
+                if (it == end) {
+                    return false;
+                }
+                string_iterator start = it++;
+                if (it == end) {
+                    return false;
+                }
+
+                switch (*it) {
+                case '?':
+                    ++it;
+                    while (true) {
+                        read_to_one_of(it, end, "\"'?");
+                        if (it == end) {
+                            return false;
+                        }
+                        if (*it != '?') {
+                            if (!skip_string(it, end)) return false;
+                        }
+                        else if (read(it, end, "?>")) {
+                            break;
+                        }
+                        else {
+                            ++it;
+                        }
+                    }
+                    break;
+                case '!':
+                    ++it;
+                    if (read(it, end, "--")) {
+                        if (!read_past(it, end, "-->")) return false;
+                    }
+                    else if (!skip_tag(it, end)) {
+                        return false;
+                    }
+                    break;
+                case '/':
+                    if (depth == 0 || !skip_tag(it, end)) {
+                        return false;
+                    }
+                    if (--depth == 1) {
+                        boundaries.push_back(it);
+                    }
+                    else if (depth == 0) {
+                        boundaries.push_back(start);
+                        return true;
+                    }
+                    break;
+                default:
+                    if (!skip_tag(it, end)) {
+                        return false;
+                    }
+                    if (!self_closing(start, it)) {
+                        if (++depth == 1) {
+                            boundaries.push_back(it);
+                        }
+                    }
+                    else if (depth == 0) {
+                        return false;
+                    }
+                    else if (depth == 1) {
+                        boundaries.push_back(it);
+                    }
+                    break;
+                }
+            }
+        }
+
+        // Skip to the end of a tag, ignoring any '>' characters in strings.
+        bool skip_tag(string_iterator& it, string_iterator end)
+        {
+            while (true) {
+                read_to_one_of(it, end, "\"'>");
+                if (it == end) {
+                    return false;
+                }
+                if (*it == '>') {
+                    ++it;
+                    return true;
+                }
+                if (!skip_string(it, end)) {
+                    return false;
+                }
+            }
+        }
+
+        bool self_closing(string_iterator start, string_iterator end)
+        {
+            assert(end - start >= 2 && end[-1] == '>');
+            string_iterator it = end - 1;
+            while (it != start && find_char(" \t\n\r", it[-1])) {
+                --it;
+            }
+            return it != start && it[-1] == '/';
+        }
 
-            return builder.release();
+        bool skip_string(string_iterator& it, string_iterator end)
+        {
+            char deliminator = *it;
+            ++it;
+            read_to(it, end, deliminator);
+            if (it == end) {
+                return false;
+            }
+            ++it;
+            return true;
         }
 
         void read_tag(
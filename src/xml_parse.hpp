@@ -9,6 +9,7 @@ http://www.boost.org/LICENSE_1_0.txt)
 #if !defined(BOOST_QUICKBOOK_XML_PARSE_HPP)
 #define BOOST_QUICKBOOK_XML_PARSE_HPP
 
+#include <cstddef>
 #include <list>
 #include <string>
 #include "string_view.hpp"
@@ -33,8 +34,11 @@ namespace quickbook
             } type_;
             std::string name_;
 
+            typedef std::list<std::pair<std::string, std::string> >
+                attribute_list;
+
           private:
-            std::list<std::pair<std::string, std::string> > attributes_;
+            attribute_list attributes_;
 
           public:
             std::string contents_;
@@ -103,6 +107,8 @@ namespace quickbook
                 return attributes_.back().second;
             }
 
+            attribute_list const& attributes() const { return attributes_; }
+
             xml_element* get_child(quickbook::string_view name)
             {
                 for (auto it = children(); it; it = it->next()) {
@@ -128,6 +134,13 @@ namespace quickbook
 
         void write_xml_tree(xml_element*);
         xml_tree xml_parse(quickbook::string_view);
+
+        // If the root element's contents are larger than 'chunk_size', its
+        // children are split into chunks of at least that size which are
+        // parsed in up to 'threads' threads. The result, and any error, is
+        // the same as for a serial parse.
+        xml_tree xml_parse(
+            quickbook::string_view, std::size_t chunk_size, unsigned threads);
     }
 }
 
@@ -4,7 +4,7 @@
 # Distributed under the Boost Software License, Version 1.0.
 # (See accompanying file LICENSE_1_0.txt or http://www.boost.org/LICENSE_1_0.txt)
 
-import sys, os, subprocess, tempfile, re
+import sys, os, subprocess, tempfile, re, shutil, time
 
 def main(args, directory):
     if len(args) != 1:
@@ -32,6 +32,35 @@ def main(args, directory):
             locations_gold = 'include_glob_locs.txt',
             input_path = ['sub1', 'sub2'])
 
+    # The same dependency tests, just scanning the documents.
+
+    failures += run_quickbook(quickbook_command, 'svg_missing.qbk',
+            deps_gold = 'svg_missing_deps.txt',
+            locations_gold = 'svg_missing_locs.txt',
+            extra_flags = ['--scan-deps'])
+    failures += run_quickbook(quickbook_command, 'missing_relative.qbk',
+            deps_gold = 'missing_relative_deps.txt',
+            locations_gold = 'missing_relative_locs.txt',
+            extra_flags = ['--scan-deps'])
+    failures += run_quickbook(quickbook_command, 'include_path.qbk',
+            deps_gold = 'include_path_deps.txt',
+            locations_gold = 'include_path_locs.txt',
+            input_path = ['sub1', 'sub2'],
+            extra_flags = ['--scan-deps'])
+    failures += run_quickbook(quickbook_command, 'include_glob.qbk',
+            deps_gold = 'include_glob_deps.txt',
+            locations_gold = 'include_glob_locs.txt',
+            input_path = ['sub1', 'sub2'],
+            extra_flags = ['--scan-deps'])
+    failures += run_quickbook(quickbook_command, 'include_cache.qbk',
+            locations_gold = 'include_cache_locs.txt',
+            extra_flags = ['--scan-deps'])
+    failures += run_quickbook(quickbook_command, 'scan_deps.qbk',
+            locations_gold = 'scan_deps_locs.txt')
+    failures += run_quickbook(quickbook_command, 'scan_deps.qbk',
+            locations_gold = 'scan_deps_locs.txt',
+            extra_flags = ['--scan-deps'])
+
     # Try building a simple document with various flags.
 
     failures += run_quickbook(quickbook_command, 'simple.qbk',
@@ -46,6 +75,38 @@ def main(args, directory):
         extra_flags = ['--indent','4','--linewidth','60'],
         output_gold = 'simple_custom_pretty_print.xml')
 
+    # Build a document twice with an include cache, the second time the
+    # included files' output should come from the cache.
+
+    cache_dir = tempfile.mkdtemp()
+    try:
+        for i in range(0, 2):
+            failures += run_quickbook(quickbook_command, 'include_cache.qbk',
+                extra_flags = ['--include-cache', cache_dir],
+                output_gold = 'include_cache.xml',
+                locations_gold = 'include_cache_locs.txt')
+        if not [x for x in os.listdir(cache_dir) if x.endswith('.qbkcache')]:
+            failures += 1
+            print "Nothing was written to the include cache."
+            print
+    finally:
+        shutil.rmtree(cache_dir)
+
+    # Check that the cached output is used, and that it isn't used once
+    # the included file has changed.
+
+    failures += run_include_cache_test(quickbook_command)
+
+    # Build chunked html twice, pages that haven't changed shouldn't be
+    # generated again.
+
+    failures += run_html_chunks_test(quickbook_command)
+
+    # Build documents in a server.
+
+    if os.name == 'posix':
+        failures += run_server_test(quickbook_command)
+
     if failures == 0:
         print "Success"
     else:
@@ -136,6 +197,197 @@ def run_quickbook(quickbook_command, filename, output_gold = None,
 
     return failures
 
+def run_include_cache_test(quickbook_command):
+    failures = 0
+
+    temp_dir = tempfile.mkdtemp()
+    try:
+        for filename in ['include_cache.qbk', 'include_cache_a.qbk',
+                'include_cache_b.qbk', 'include_cache_c.qbk',
+                'include_cache_d.qbk']:
+            shutil.copy(filename, temp_dir)
+        cache_dir = os.path.join(temp_dir, 'cache')
+        output_filename = os.path.join(temp_dir, 'include_cache.xml')
+        gold = load_file('include_cache.xml')
+
+        command = [quickbook_command, '--debug',
+                os.path.join(temp_dir, 'include_cache.qbk'),
+                '--output-file', output_filename,
+                '--include-cache', cache_dir]
+
+        def run():
+            print 'Running: ' + ' '.join(command)
+            print
+            exit_code = subprocess.call(command)
+            print
+            return exit_code
+
+        failures += run() != 0
+        if load_file(output_filename) != gold:
+            failures += 1
+            print "Output doesn't match gold."
+            print
+
+        # Change the text in the cache entries, without changing its
+        # length, so that the output shows whether they were used.
+        cache_files = [os.path.join(cache_dir, x)
+                for x in os.listdir(cache_dir) if x.endswith('.qbkcache')]
+        modified = False
+        for path in cache_files:
+            entry = load_file(path)
+            if 'Link to A' in entry:
+                f = open(path, 'wb')
+                f.write(entry.replace('Link to A', 'Link to Z'))
+                f.close()
+                modified = True
+        if not modified:
+            failures += 1
+            print "Included file's output wasn't cached."
+            print
+
+        failures += run() != 0
+        if load_file(output_filename) != gold.replace('Link to A', 'Link to Z'):
+            failures += 1
+            print "Output wasn't replayed from the cache."
+            print
+
+        # Changing the included file should stop its entry being used.
+        path = os.path.join(temp_dir, 'include_cache_b.qbk')
+        source = load_file(path)
+        f = open(path, 'w')
+        f.write(source.replace('Link to A', 'Link to B'))
+        f.close()
+
+        failures += run() != 0
+        if load_file(output_filename) != gold.replace('Link to A', 'Link to B'):
+            failures += 1
+            print "Changed file was replayed from the cache."
+            print
+    finally:
+        shutil.rmtree(temp_dir)
+
+    return failures
+
+def run_html_chunks_test(quickbook_command):
+    failures = 0
+
+    temp_dir = tempfile.mkdtemp()
+    try:
+        for filename in ['html_chunks.qbk', 'html_chunks_1.qbk',
+                'html_chunks_2.qbk']:
+            shutil.copy(filename, temp_dir)
+        html_dir = os.path.join(temp_dir, 'html')
+        os.mkdir(html_dir)
+        pages = ['index.html', 'first.html', 'second.html']
+
+        command = [quickbook_command, '--debug',
+                os.path.join(temp_dir, 'html_chunks.qbk'),
+                '--output-format', 'html']
+
+        def run():
+            print 'Running: ' + ' '.join(command)
+            print
+            exit_code = subprocess.call(command)
+            print
+            return exit_code
+
+        failures += run() != 0
+        original = {}
+        for page in pages:
+            original[page] = load_file(os.path.join(html_dir, page))
+            os.utime(os.path.join(html_dir, page), (0, 0))
+
+        # Only the modified page should be written.
+        f = open(os.path.join(html_dir, 'second.html'), 'w')
+        f.write('Modified')
+        f.close()
+        os.utime(os.path.join(html_dir, 'second.html'), (0, 0))
+
+        failures += run() != 0
+        for page in pages:
+            path = os.path.join(html_dir, page)
+            if load_file(path) != original[page]:
+                failures += 1
+                print "Output doesn't match for:", page
+                print
+            if (os.path.getmtime(path) != 0) != (page == 'second.html'):
+                failures += 1
+                print "Unexpected write to:", page
+                print
+            os.utime(path, (0, 0))
+
+        # Adding a footnote to the first chapter changes the number of the
+        # footnote in the second chapter.
+        f = open(os.path.join(temp_dir, 'html_chunks_1.qbk'), 'a')
+        f.write('\n[footnote Extra footnote.]\n')
+        f.close()
+
+        failures += run() != 0
+        for page in pages:
+            path = os.path.join(html_dir, page)
+            if (os.path.getmtime(path) != 0) != (page != 'index.html'):
+                failures += 1
+                print "Unexpected write to:", page
+                print
+        if '[4]' not in load_file(os.path.join(html_dir, 'second.html')):
+            failures += 1
+            print "Footnote not renumbered."
+            print
+    finally:
+        shutil.rmtree(temp_dir)
+
+    return failures
+
+def run_server_test(quickbook_command):
+    failures = 0
+
+    temp_dir = tempfile.mkdtemp()
+    socket_path = os.path.join(temp_dir, 'socket')
+    command = [quickbook_command, '--server', socket_path,
+            '--preload-file', 'simple.qbk']
+    print 'Running: ' + ' '.join(command)
+    print
+    server = subprocess.Popen(command)
+    try:
+        for i in range(0, 100):
+            if os.path.exists(socket_path) or server.poll() is not None:
+                break
+            time.sleep(0.1)
+        if not os.path.exists(socket_path):
+            print "Server didn't start."
+            print
+            return 1
+
+        failures += run_quickbook(quickbook_command, 'simple.qbk',
+            extra_flags = ['--connect', socket_path],
+            output_gold = 'simple.xml')
+        failures += run_quickbook(quickbook_command, 'include_path.qbk',
+            deps_gold = 'include_path_deps.txt',
+            locations_gold = 'include_path_locs.txt',
+            input_path = ['sub1', 'sub2'],
+            extra_flags = ['--connect', socket_path])
+
+        # Errors are reported through the client.
+        command = [quickbook_command, '--connect', socket_path,
+                'missing.qbk']
+        print 'Running: ' + ' '.join(command)
+        print
+        if subprocess.call(command) == 0:
+            failures += 1
+            print "No error for missing file."
+        print
+    finally:
+        if server.poll() is None:
+            server.terminate()
+            server.wait()
+        else:
+            failures += 1
+            print "Server exited."
+            print
+        shutil.rmtree(temp_dir)
+
+    return failures
+
 def load_dependencies(filename):
     dependencies = set()
     f = open(filename, 'r')
@@ -0,0 +1,219 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+#include <sstream>
+#include <string>
+#include <boost/detail/lightweight_test.hpp>
+#include "diagnostics.hpp"
+
+typedef quickbook::detail::diagnostic_sink diagnostic_sink;
+typedef quickbook::detail::stream_string stream_string;
+typedef std::basic_ostringstream<stream_string::value_type> ostringstream;
+
+// The messages are all ascii, so this works for wide streams.
+stream_string native(std::string const& x)
+{
+    return stream_string(x.begin(), x.end());
+}
+
+void add_repeated(diagnostic_sink& sink)
+{
+    diagnostic_sink::site site1("doc.qbk", 10);
+    diagnostic_sink::site site2("doc.qbk", 20);
+
+    sink.add(
+        diagnostic_sink::warning, "template.qbk", 3, native("Repeated.\n"),
+        site1);
+    sink.add(diagnostic_sink::error, "doc.qbk", 5, native("Once.\n"));
+    sink.add(
+        diagnostic_sink::warning, "template.qbk", 3, native("Repeated.\n"),
+        site2);
+    sink.add(
+        diagnostic_sink::warning, "template.qbk", 3, native("Repeated.\n"),
+        site1);
+}
+
+void text_test()
+{
+    diagnostic_sink sink;
+    add_repeated(sink);
+    sink.add(diagnostic_sink::error, "", -1, native("No location.\n"));
+    BOOST_TEST(!sink.empty());
+
+    ostringstream out;
+    sink.write(out);
+    BOOST_TEST(sink.empty());
+    BOOST_TEST(
+        out.str() == native("template.qbk:3: warning: Repeated.\n"
+                            "template.qbk:3: note: occurred 3 times\n"
+                            "doc.qbk:10: note: expanded from here\n"
+                            "doc.qbk:20: note: expanded from here\n"
+                            "doc.qbk:5: error: Once.\n"
+                            "Error: No location.\n"));
+
+    // Written diagnostics are cleared.
+    ostringstream out2;
+    sink.write(out2);
+    BOOST_TEST(out2.str().empty());
+}
+
+void max_diagnostics_test()
+{
+    diagnostic_sink sink;
+    sink.max_diagnostics = 1;
+    sink.ms_errors = true;
+    add_repeated(sink);
+
+    ostringstream out;
+    sink.finish(out);
+    BOOST_TEST(
+        out.str() == native("template.qbk(3): warning: Repeated.\n"
+                            "template.qbk(3): note: occurred 3 times\n"
+                            "doc.qbk(10): note: expanded from here\n"
+                            "doc.qbk(20): note: expanded from here\n"
+                            "Note: 1 more diagnostics not shown\n"));
+}
+
+void max_diagnostics_run_test()
+{
+    diagnostic_sink sink;
+    sink.max_diagnostics = 2;
+
+    // The limit is for the whole run, not each write.
+    ostringstream out;
+    sink.add(diagnostic_sink::error, "doc.qbk", 1, native("First.\n"));
+    sink.write(out);
+    sink.add(diagnostic_sink::error, "doc.qbk", 2, native("Second.\n"));
+    sink.add(diagnostic_sink::error, "doc.qbk", 3, native("Third.\n"));
+    sink.write(out);
+    sink.add(diagnostic_sink::warning, "doc.qbk", 4, native("Fourth.\n"));
+    sink.finish(out);
+    BOOST_TEST(
+        out.str() == native("doc.qbk:1: error: First.\n"
+                            "doc.qbk:2: error: Second.\n"
+                            "Note: 2 more diagnostics not shown\n"));
+
+    // Finishing starts the count again.
+    ostringstream out2;
+    sink.add(diagnostic_sink::error, "doc.qbk", 5, native("Fifth.\n"));
+    sink.finish(out2);
+    BOOST_TEST(out2.str() == native("doc.qbk:5: error: Fifth.\n"));
+}
+
+void max_diagnostics_summary_test()
+{
+    diagnostic_sink sink;
+    sink.max_diagnostics = 1;
+
+    // Summaries are always written, and aren't counted as diagnostics.
+    ostringstream out;
+    sink.add(diagnostic_sink::error, "doc.qbk", 1, native("First.\n"));
+    sink.add(diagnostic_sink::error, "doc.qbk", 2, native("Second.\n"));
+    sink.add(diagnostic_sink::summary, "", -1, native("Error count: 2.\n"));
+    sink.finish(out);
+    BOOST_TEST(
+        out.str() == native("doc.qbk:1: error: First.\n"
+                            "Error: Error count: 2.\n"
+                            "Note: 1 more diagnostics not shown\n"));
+
+    ostringstream out2;
+    sink.output_format = diagnostic_sink::json;
+    sink.add(diagnostic_sink::error, "doc.qbk", 1, native("First.\n"));
+    sink.add(diagnostic_sink::error, "doc.qbk", 2, native("Second.\n"));
+    sink.add(diagnostic_sink::summary, "", -1, native("Error count: 2.\n"));
+    sink.finish(out2);
+    BOOST_TEST(
+        out2.str() ==
+        native("{\n"
+               "  \"diagnostics\": [\n"
+               "    {\"severity\": \"error\", \"file\": \"doc.qbk\", "
+               "\"line\": 1, \"message\": \"First.\", \"count\": 1, "
+               "\"expanded_from\": []},\n"
+               "    {\"severity\": \"summary\", "
+               "\"message\": \"Error count: 2.\", \"count\": 1, "
+               "\"expanded_from\": []}\n"
+               "  ],\n"
+               "  \"not_shown\": 1\n"
+               "}\n"));
+}
+
+void max_sites_test()
+{
+    diagnostic_sink sink;
+    for (int i = 0; i < 10; ++i) {
+        sink.add(
+            diagnostic_sink::warning, "template.qbk", 1, native("Warning.\n"),
+            diagnostic_sink::site("doc.qbk", i));
+    }
+
+    ostringstream out;
+    sink.write(out);
+    BOOST_TEST(
+        out.str() == native("template.qbk:1: warning: Warning.\n"
+                            "template.qbk:1: note: occurred 10 times\n"
+                            "doc.qbk:0: note: expanded from here\n"
+                            "doc.qbk:1: note: expanded from here\n"
+                            "doc.qbk:2: note: expanded from here\n"));
+}
+
+void errors_not_merged_test()
+{
+    diagnostic_sink sink;
+    for (int i = 0; i < 2; ++i) {
+        sink.add(diagnostic_sink::error, "doc.qbk", 6, native("Error.\n"));
+        sink.add(
+            diagnostic_sink::warning, "doc.qbk", 6, native("Warning.\n"));
+    }
+
+    ostringstream out;
+    sink.write(out);
+    BOOST_TEST(
+        out.str() == native("doc.qbk:6: error: Error.\n"
+                            "doc.qbk:6: warning: Warning.\n"
+                            "doc.qbk:6: note: occurred 2 times\n"
+                            "doc.qbk:6: error: Error.\n"));
+}
+
+void json_test()
+{
+    diagnostic_sink sink;
+    sink.output_format = diagnostic_sink::json;
+    sink.max_diagnostics = 1;
+    add_repeated(sink);
+
+    // JSON is only written when the run is finished.
+    ostringstream out;
+    sink.write(out);
+    BOOST_TEST(out.str().empty());
+    BOOST_TEST(!sink.empty());
+
+    sink.finish(out);
+    BOOST_TEST(
+        out.str() ==
+        native("{\n"
+               "  \"diagnostics\": [\n"
+               "    {\"severity\": \"warning\", \"file\": \"template.qbk\", "
+               "\"line\": 3, \"message\": \"Repeated.\", \"count\": 3, "
+               "\"expanded_from\": [{\"file\": \"doc.qbk\", \"line\": 10}, "
+               "{\"file\": \"doc.qbk\", \"line\": 20}]}\n"
+               "  ],\n"
+               "  \"not_shown\": 1\n"
+               "}\n"));
+}
+
+int main()
+{
+    text_test();
+    max_diagnostics_test();
+    max_diagnostics_run_test();
+    max_diagnostics_summary_test();
+    max_sites_test();
+    errors_not_merged_test();
+    json_test();
+    return boost::report_errors();
+}
@@ -355,6 +355,43 @@ void indented_map_leading_blanks_test()
     }
 }
 
+// The unindented text should be mapped to its original position, not to the
+// blank lines before it.
+void indented_map_leading_blanks_position_test()
+{
+    quickbook::mapped_file_builder builder;
+
+    {
+        quickbook::string_view source("\n\n   Code line1\n");
+        quickbook::file_ptr fake_file =
+            new quickbook::file("(fake file)", source, 105u);
+        builder.start(fake_file);
+        builder.unindent_and_add(fake_file->source());
+        quickbook::file_ptr f1 = builder.release();
+        BOOST_TEST_EQ(
+            f1->position_of(f1->source().begin()),
+            quickbook::file_position(3, 4));
+        BOOST_TEST_EQ(
+            f1->position_of(f1->source().begin() + 4),
+            quickbook::file_position(3, 8));
+    }
+
+    {
+        quickbook::string_view source("    \n  \n   Code line1\n");
+        quickbook::file_ptr fake_file =
+            new quickbook::file("(fake file)", source, 105u);
+        builder.start(fake_file);
+        builder.unindent_and_add(fake_file->source());
+        quickbook::file_ptr f1 = builder.release();
+        BOOST_TEST_EQ(
+            f1->position_of(f1->source().begin()),
+            quickbook::file_position(3, 4));
+        BOOST_TEST_EQ(
+            f1->position_of(f1->source().begin() + 10),
+            quickbook::file_position(3, 14));
+    }
+}
+
 void indented_map_trailing_blanks_test()
 {
     quickbook::mapped_file_builder builder;
@@ -438,6 +475,7 @@ int main()
     indented_map_tests();
     indented_map_tests2();
     indented_map_leading_blanks_test();
+    indented_map_leading_blanks_position_test();
     indented_map_trailing_blanks_test();
     indented_map_mixed_test();
     return boost::report_errors();
@@ -0,0 +1,130 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// The timings aren't predictable, so these only check the output sizes
+// and the lines that they're attributed to.
+
+#include <sstream>
+#include <boost/detail/lightweight_test.hpp>
+#include "files.hpp"
+#include "source_profile.hpp"
+
+bool contains(std::string const& x, std::string const& y)
+{
+    return x.find(y) != std::string::npos;
+}
+
+std::size_t count(std::string const& x, std::string const& y)
+{
+    std::size_t n = 0;
+    for (std::string::size_type pos = x.find(y); pos != std::string::npos;
+         pos = x.find(y, pos + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+void nested_test()
+{
+    quickbook::file_ptr fake_file = new quickbook::file(
+        "fake.qbk", "Line 1\n[b Line 2]\nLine 3\n", 106u);
+    quickbook::string_iterator begin = fake_file->source().begin();
+
+    quickbook::source_profiler profiler;
+    profiler.start(0);
+    profiler.start(10);
+    profiler.stop(fake_file, begin + 7, begin + 17, 25);
+    profiler.start(25);
+    profiler.cancel();
+    profiler.stop(fake_file, begin, fake_file->source().end(), 40);
+
+    std::ostringstream out;
+    profiler.write_report(out, quickbook::source_profiler::json, 0);
+    std::string report = out.str();
+
+    BOOST_TEST(contains(
+        report, "{\"file\": \"fake.qbk\", \"first_line\": 2, "
+                "\"last_line\": 2, \"count\": 1, "));
+    BOOST_TEST(contains(report, "\"output_bytes\": 15}"));
+    BOOST_TEST(contains(
+        report, "{\"file\": \"fake.qbk\", \"first_line\": 1, "
+                "\"last_line\": 3, \"count\": 1, "));
+    BOOST_TEST(contains(report, "\"output_bytes\": 25}"));
+    BOOST_TEST(contains(report, "\"output_bytes\": 40}"));
+}
+
+void merge_test()
+{
+    quickbook::file_ptr fake_file =
+        new quickbook::file("fake.qbk", "[a] [a]\n", 106u);
+    quickbook::string_iterator begin = fake_file->source().begin();
+
+    quickbook::source_profiler profiler;
+    profiler.start(0);
+    profiler.stop(fake_file, begin, begin + 3, 5);
+    profiler.start(5);
+    profiler.stop(fake_file, begin + 4, begin + 7, 10);
+    profiler.start(10);
+    profiler.stop(fake_file, begin + 4, begin + 7, 15);
+
+    std::ostringstream out;
+    profiler.write_report(out, quickbook::source_profiler::json, 0);
+    std::string report = out.str();
+
+    BOOST_TEST(contains(
+        report, "{\"file\": \"fake.qbk\", \"first_line\": 1, "
+                "\"last_line\": 1, \"count\": 2, "));
+    BOOST_TEST(contains(report, "\"output_bytes\": 15}"));
+}
+
+void per_file_test()
+{
+    quickbook::file_ptr file1 =
+        new quickbook::file("one.qbk", "a\nb\nc\n", 106u);
+    quickbook::file_ptr file2 =
+        new quickbook::file("two.qbk", "d\ne\n", 106u);
+    quickbook::string_iterator begin1 = file1->source().begin();
+    quickbook::string_iterator begin2 = file2->source().begin();
+
+    quickbook::source_profiler profiler;
+    profiler.start(0);
+    profiler.stop(file1, begin1, begin1 + 1, 10);
+    profiler.start(10);
+    profiler.stop(file1, begin1 + 2, begin1 + 3, 30);
+    profiler.start(30);
+    profiler.stop(file1, begin1 + 4, begin1 + 5, 60);
+    profiler.start(60);
+    profiler.stop(file2, begin2, begin2 + 1, 61);
+    profiler.start(61);
+    profiler.stop(file2, begin2 + 2, begin2 + 3, 63);
+
+    std::ostringstream out;
+    profiler.write_report(out, quickbook::source_profiler::json, 1);
+    std::string report = out.str();
+
+    // Only one range from each file.
+    BOOST_TEST(count(report, "{\"file\": \"one.qbk\", \"first_line\"") == 1);
+    BOOST_TEST(count(report, "{\"file\": \"two.qbk\", \"first_line\"") == 1);
+
+    std::ostringstream text;
+    profiler.write_report(text, quickbook::source_profiler::text, 2);
+    report = text.str();
+
+    BOOST_TEST(contains(report, "Most expensive lines in one.qbk:\n"));
+    BOOST_TEST(contains(report, "Most expensive lines in two.qbk:\n"));
+    BOOST_TEST(count(report, "one.qbk:") == 3);
+    BOOST_TEST(count(report, "two.qbk:") == 3);
+}
+
+int main()
+{
+    nested_test();
+    merge_test();
+    per_file_test();
+    return boost::report_errors();
+}
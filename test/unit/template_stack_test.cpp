@@ -0,0 +1,77 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// Check that template arguments are found, and that scopes are cleared
+// when they're reused.
+
+#include <string>
+#include <vector>
+#include <boost/detail/lightweight_test.hpp>
+#include "files.hpp"
+#include "template_stack.hpp"
+#include "values.hpp"
+
+quickbook::value phrase(quickbook::file_ptr const& f)
+{
+    return quickbook::qbk_value(
+        f, f->source().begin(), f->source().end(),
+        quickbook::template_tags::phrase);
+}
+
+void arguments_test()
+{
+    quickbook::file_ptr fake_file =
+        new quickbook::file("(fake file)", "Body", 107u);
+
+    std::vector<std::string> params;
+    params.push_back("a");
+    params.push_back("b");
+    std::vector<quickbook::value> args;
+    args.push_back(phrase(fake_file));
+    args.push_back(phrase(fake_file));
+
+    quickbook::template_stack templates;
+    quickbook::template_scope const* root = &templates.top_scope();
+
+    templates.push();
+    quickbook::template_scope const* scope = &templates.top_scope();
+    BOOST_TEST(templates.add_arguments(params, args, root));
+
+    quickbook::template_symbol const* a = templates.find("a");
+    BOOST_TEST(a && a->identifier == "a");
+    BOOST_TEST(a && a->lexical_parent == root);
+    BOOST_TEST(a && a->params.empty());
+    BOOST_TEST(templates.find_top_scope("b"));
+    BOOST_TEST(!templates.find("c"));
+
+    // Templates can't have the same name as an argument.
+    BOOST_TEST(!templates.add(quickbook::template_symbol(
+        "a", std::vector<std::string>(), phrase(fake_file), scope)));
+    BOOST_TEST(templates.add(quickbook::template_symbol(
+        "c", std::vector<std::string>(), phrase(fake_file), scope)));
+    BOOST_TEST(templates.find("c"));
+
+    templates.pop();
+    BOOST_TEST(!templates.find("a"));
+
+    // The scope is reused, without the old arguments and templates.
+    templates.push();
+    BOOST_TEST(&templates.top_scope() == scope);
+    BOOST_TEST(!templates.find("a"));
+    BOOST_TEST(!templates.find("c"));
+
+    params[1] = "a";
+    BOOST_TEST(!templates.add_arguments(params, args, root));
+    templates.pop();
+}
+
+int main()
+{
+    arguments_test();
+    return boost::report_errors();
+}
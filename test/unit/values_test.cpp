@@ -88,6 +88,52 @@ void multiple_list_test()
     BOOST_TEST(!l2.check());
 }
 
+void save_restore_test()
+{
+    quickbook::value_builder b;
+    b.insert(quickbook::encoded_value("a", 1));
+
+    b.save();
+    BOOST_TEST(b.empty());
+    b.insert(quickbook::encoded_value("discarded"));
+    b.start_list(5);
+    b.insert(quickbook::encoded_value("discarded"));
+    b.restore();
+    b.restore();
+
+    b.start_list(2);
+    b.insert(quickbook::encoded_value("b"));
+    b.start_list(3);
+    b.insert(quickbook::encoded_value("c"));
+    b.finish_list();
+    b.finish_list();
+
+    b.start_list(4);
+    b.insert(quickbook::encoded_value("discarded"));
+    b.clear_list();
+
+    quickbook::value_consumer c = b.release();
+    BOOST_TEST(c.check(1));
+    BOOST_TEST_EQ(c.consume(1).get_encoded(), "a");
+    BOOST_TEST(c.check(2));
+    quickbook::value_consumer c2 = c.consume(2);
+    BOOST_TEST(!c.check());
+
+    BOOST_TEST_EQ(c2.consume().get_encoded(), "b");
+    BOOST_TEST(c2.check(3));
+    quickbook::value_consumer c3 = c2.consume(3);
+    BOOST_TEST(!c2.check());
+    BOOST_TEST_EQ(c3.consume().get_encoded(), "c");
+    BOOST_TEST(!c3.check());
+
+    // Destroying a builder with saved lists.
+    quickbook::value_builder b2;
+    b2.insert(quickbook::encoded_value("a"));
+    b2.save();
+    b2.insert(quickbook::encoded_value("b"));
+    b2.start_list();
+}
+
 void equality_tests()
 {
     std::vector<quickbook::value> distinct_values;
@@ -122,6 +168,7 @@ int main()
     qbk_tests();
     sort_test();
     multiple_list_test();
+    save_restore_test();
     equality_tests();
 
     return boost::report_errors();
@@ -0,0 +1,96 @@
+/*=============================================================================
+    Copyright (c) 2026 agent
+
+    Use, modification and distribution is subject to the Boost Software
+    License, Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+    http://www.boost.org/LICENSE_1_0.txt)
+=============================================================================*/
+
+// Check that parsing a document in chunks gives the same result as parsing
+// it in one go.
+
+#include <string>
+#include <boost/detail/lightweight_test.hpp>
+#include "xml_parse.hpp"
+
+namespace qd = quickbook::detail;
+
+std::string dump(qd::xml_element* node)
+{
+    std::string result;
+    for (; node; node = node->next()) {
+        switch (node->type_) {
+        case qd::xml_element::element_node:
+            result += "<" + node->name_;
+            for (auto& a : node->attributes()) {
+                result += " " + a.first + "='" + a.second + "'";
+            }
+            result += ">" + dump(node->children()) + "</>";
+            break;
+        default:
+            result += "[" + node->contents_ + "]";
+            break;
+        }
+        if (node->next() && node->next()->prev() != node) {
+            result += "(bad prev)";
+        }
+        if (node->parent() && node->parent()->children() != node &&
+            !node->prev()) {
+            result += "(bad parent)";
+        }
+    }
+    return result;
+}
+
+std::string parse(std::string const& source, std::size_t chunk_size)
+{
+    try {
+        return dump(qd::xml_parse(source, chunk_size, 4).root());
+    } catch (qd::xml_parse_error& e) {
+        return std::string(e.message) + " at " +
+               std::to_string(e.pos - quickbook::string_view(source).begin());
+    }
+}
+
+void compare(std::string const& source)
+{
+    std::string expected = parse(source, std::size_t(-1));
+    for (std::size_t chunk_size = 1; chunk_size < 64; chunk_size *= 2) {
+        BOOST_TEST_EQ(parse(source, chunk_size), expected);
+    }
+}
+
+void chunks_test()
+{
+    compare("");
+    compare("<a/>");
+    compare("<?xml version='1.0'?>\n<!DOCTYPE a>\n"
+            "<a x='>'><b>1</b> <c y=\"/\"/>"
+            "<!-- <d> --><d><e/><e>2</e></d>text<f / ></a>\n");
+
+    std::string source = "<book id='b'>";
+    for (int i = 0; i < 20; ++i) {
+        source += "<section><title>T</title><para>Some <emphasis>text"
+                  "</emphasis></para></section>\n";
+    }
+    source += "</book>";
+    compare(source);
+}
+
+void errors_test()
+{
+    compare("<a><b></c></a>");
+    compare("<a><b>x</b><c>y</b><d/></a>");
+    compare("<a><b>x</b><c>y</c><d/>");
+    compare("<a><b>x</b><c x=y></c><d/></a>");
+    compare("<a><b>x</b><c><d/></a>");
+    compare("<a><b>x</b><c></c></a></a><d/>");
+    compare("<a><b>x</b><!-- <c></c><d/></a>");
+}
+
+int main()
+{
+    chunks_test();
+    errors_test();
+    return boost::report_errors();
+}